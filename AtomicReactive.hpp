@@ -0,0 +1,202 @@
+#pragma once
+
+#include <atomic>
+#include <Reactive.hpp>
+#include <Signal.hpp>
+
+namespace cppreactive {
+    template <typename T>
+    concept AtomicReactiveValue = std::is_trivially_copyable_v<T> && std::atomic<T>::is_always_lock_free;
+
+    /// Lock-free counterpart to Reactive for small trivially copyable values such as `int`, `float` or `bool`.
+    /// Reads are a single acquire load and never take a lock. Listener bookkeeping is only allocated once
+    /// something reacts, so an unobserved instance is just a few words large.
+    ///
+    /// Unlike Reactive, writes are not guarded against reentrancy: a listener setting the value it is
+    /// listening to will recurse.
+    template <AtomicReactiveValue T, typename Compare = DefaultEqual<T>>
+    class AtomicReactive {
+        /// Shared with every Ref, which keeps unreacting safe after the AtomicReactive is gone.
+        struct Core : ListenerCore<Core, T> {
+            AtomicReactive* m_reactive;
+
+            Core(AtomicReactive* reactive) : m_reactive(reactive) {}
+
+            std::optional<T> current() const {
+                if (m_reactive)
+                    return m_reactive->get();
+                return {};
+            }
+
+            /// Refs read through the lock, since the AtomicReactive may be going away
+            std::optional<T> get() {
+                std::lock_guard<std::mutex> lock(this->m_mutex);
+                return current();
+            }
+
+            /// Called with the lock held once the value changed. Releases the lock and notifies listeners.
+            void notifyChanged(std::shared_ptr<Core> const& self, std::unique_lock<std::mutex>& lock, T value) {
+                if (!this->deferToBatch(self))
+                    this->notify(lock, value);
+            }
+
+            template <typename Q>
+            bool set(std::shared_ptr<Core> const& self, Q&& val) {
+                std::unique_lock<std::mutex> lock(this->m_mutex);
+                auto reactive = m_reactive;
+                if (!reactive)
+                    return false;
+
+                T value = std::forward<Q>(val);
+                if (!reactive->m_compare(reactive->m_value.exchange(value, std::memory_order_acq_rel), value))
+                    notifyChanged(self, lock, value);
+                return true;
+            }
+
+            template <typename F>
+            bool update(std::shared_ptr<Core> const& self, F& fn) {
+                std::unique_lock<std::mutex> lock(this->m_mutex);
+                auto reactive = m_reactive;
+                if (!reactive)
+                    return false;
+
+                if (auto next = reactive->exchangeWith(fn))
+                    notifyChanged(self, lock, *next);
+                return true;
+            }
+        };
+
+        std::atomic<T> m_value;
+        [[no_unique_address]] Compare m_compare;
+        std::atomic<Core*> m_core = nullptr;
+        std::atomic_flag m_coreLock = ATOMIC_FLAG_INIT;
+        std::shared_ptr<Core> m_coreOwner;
+
+        /// Replaces the value with `fn(value)` in a compare-and-swap loop. Returns the new value, or nothing if `fn`
+        /// left it unchanged.
+        template <typename F>
+        std::optional<T> exchangeWith(F& fn) {
+            T current = m_value.load(std::memory_order_acquire);
+            while (true) {
+                T next = fn(current);
+                if (m_compare(current, next))
+                    return {};
+                if (m_value.compare_exchange_weak(current, next, std::memory_order_acq_rel, std::memory_order_acquire))
+                    return next;
+            }
+        }
+
+        void notifyChanged(T value) {
+            if (auto core = m_core.load(std::memory_order_acquire)) {
+                std::unique_lock<std::mutex> lock(core->m_mutex);
+                core->notifyChanged(m_coreOwner, lock, value);
+            }
+        }
+
+        Core* core() {
+            if (auto core = m_core.load(std::memory_order_acquire))
+                return core;
+
+            while (m_coreLock.test_and_set(std::memory_order_acquire));
+            if (!m_coreOwner) {
+                m_coreOwner = std::make_shared<Core>(this);
+                m_core.store(m_coreOwner.get(), std::memory_order_release);
+            }
+            m_coreLock.clear(std::memory_order_release);
+
+            return m_coreOwner.get();
+        }
+     public:
+        using ListenerIter = ListenerHandle;
+        using Ref = CoreRef<Core, T>;
+
+        AtomicReactive() : m_value() {}
+        AtomicReactive(T initial) : m_value(initial) {}
+        AtomicReactive(AtomicReactive const& other) : m_value(other.get()), m_compare(other.m_compare) {}
+        AtomicReactive(AtomicReactive&& other) : m_value(other.get()), m_compare(other.m_compare) {
+            while (other.m_coreLock.test_and_set(std::memory_order_acquire));
+            m_coreOwner = std::move(other.m_coreOwner);
+            other.m_core.store(nullptr, std::memory_order_release);
+            other.m_coreLock.clear(std::memory_order_release);
+
+            if (m_coreOwner) {
+                std::lock_guard<std::mutex> lock(m_coreOwner->m_mutex);
+                m_coreOwner->m_reactive = this;
+                m_core.store(m_coreOwner.get(), std::memory_order_release);
+            }
+        }
+
+        ~AtomicReactive() {
+            if (m_coreOwner) {
+                std::lock_guard<std::mutex> lock(m_coreOwner->m_mutex);
+                m_coreOwner->m_reactive = nullptr;
+            }
+        }
+
+        template <typename Q>
+        void set(Q&& val) {
+            T value = std::forward<Q>(val);
+            if (!m_compare(m_value.exchange(value, std::memory_order_acq_rel), value))
+                notifyChanged(value);
+        }
+
+        /// Replaces the value with `fn(value)` atomically, retrying `fn` if another write gets in between, so
+        /// concurrent updates never lose each other's writes. Listeners are notified once with the value stored.
+        /// `fn` may run several times and should not have side effects.
+        template <typename F> requires std::convertible_to<std::invoke_result_t<F&, T const&>, T>
+        void update(F&& fn) {
+            if (auto next = exchangeWith(fn))
+                notifyChanged(*next);
+        }
+
+        AtomicReactive& operator++() {
+            update([](T const& value) { return value + 1; });
+            return *this;
+        }
+        AtomicReactive& operator--() {
+            update([](T const& value) { return value - 1; });
+            return *this;
+        }
+
+        T get() const {
+            return m_value.load(std::memory_order_acquire);
+        }
+
+        template <typename Q>
+        AtomicReactive& operator=(Q&& val) {
+            set(std::forward<Q>(val));
+            return *this;
+        }
+
+        AtomicReactive& operator=(AtomicReactive const& val) {
+            set(val.get());
+            return *this;
+        }
+        operator T() const {
+            return get();
+        }
+
+        template <typename F> requires std::invocable<std::decay_t<F>&, T const&>
+        ListenerIter react(F&& fn) {
+            return core()->react(std::forward<F>(fn));
+        }
+        void unreact(ListenerIter it) {
+            if (auto core = m_core.load(std::memory_order_acquire))
+                core->unreact(it);
+        }
+
+        Ref ref() {
+            core();
+            return Ref(m_coreOwner);
+        }
+    };
+
+    template <AtomicReactiveValue T, typename Compare = DefaultEqual<T>>
+    class AtomicSignal : public SignalBase<AtomicReactive<T, Compare>> {
+        using SignalBase<AtomicReactive<T, Compare>>::SignalBase;
+     public:
+
+        template <std::convertible_to<T> Q>
+        AtomicSignal(Q&& value) : SignalBase<AtomicReactive<T, Compare>>(AtomicReactive<T, Compare>(static_cast<T>(value))) {}
+    };
+}
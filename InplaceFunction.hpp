@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/// Bytes of captured state a listener can hold before InplaceFunction falls back to the heap
+#ifndef CPP_REACTIVE_LISTENER_CAPACITY
+    #define CPP_REACTIVE_LISTENER_CAPACITY (4 * sizeof(void*))
+#endif
+
+namespace cppreactive {
+    template <typename Signature, size_t Capacity = CPP_REACTIVE_LISTENER_CAPACITY>
+    class InplaceFunction;
+
+    /// Copyable type-erased callable like std::function, except that callables of up to `Capacity` bytes are
+    /// stored inline rather than allocated. Larger callables still work, they just go on the heap.
+    template <typename R, typename ...Args, size_t Capacity>
+    class InplaceFunction<R(Args...), Capacity> {
+        struct VTable {
+            R (*invoke)(void* storage, Args&&... args);
+            void (*copy)(void const* from, void* to);
+            /// Moves into `to` and destroys what is left in `from`
+            void (*relocate)(void* from, void* to);
+            void (*destroy)(void* storage);
+        };
+
+        template <typename F>
+        static constexpr bool s_inline = sizeof(F) <= Capacity
+            && alignof(F) <= alignof(std::max_align_t)
+            && std::is_nothrow_move_constructible_v<F>;
+
+        template <typename F>
+        static constexpr VTable s_inlineTable = {
+            [](void* storage, Args&&... args) -> R {
+                return std::invoke(*static_cast<F*>(storage), std::forward<Args>(args)...);
+            },
+            [](void const* from, void* to) { new (to) F(*static_cast<F const*>(from)); },
+            [](void* from, void* to) {
+                new (to) F(std::move(*static_cast<F*>(from)));
+                static_cast<F*>(from)->~F();
+            },
+            [](void* storage) { static_cast<F*>(storage)->~F(); },
+        };
+
+        template <typename F>
+        static constexpr VTable s_heapTable = {
+            [](void* storage, Args&&... args) -> R {
+                return std::invoke(**static_cast<F**>(storage), std::forward<Args>(args)...);
+            },
+            [](void const* from, void* to) { new (to) F*(new F(**static_cast<F* const*>(from))); },
+            [](void* from, void* to) { new (to) F*(*static_cast<F**>(from)); },
+            [](void* storage) { delete *static_cast<F**>(storage); },
+        };
+
+        alignas(std::max_align_t) unsigned char m_storage[Capacity < sizeof(void*) ? sizeof(void*) : Capacity];
+        VTable const* m_vtable = nullptr;
+     public:
+        InplaceFunction() = default;
+
+        template <typename F>
+            requires (!std::is_same_v<std::decay_t<F>, InplaceFunction> && std::is_invocable_r_v<R, std::decay_t<F>&, Args...>)
+        InplaceFunction(F&& fn) {
+            using Fn = std::decay_t<F>;
+            static_assert(std::is_copy_constructible_v<Fn>, "Listeners have to be copyable");
+
+            if constexpr (s_inline<Fn>) {
+                new (m_storage) Fn(std::forward<F>(fn));
+                m_vtable = &s_inlineTable<Fn>;
+            } else {
+                new (m_storage) Fn*(new Fn(std::forward<F>(fn)));
+                m_vtable = &s_heapTable<Fn>;
+            }
+        }
+
+        InplaceFunction(InplaceFunction const& other) : m_vtable(other.m_vtable) {
+            if (m_vtable)
+                m_vtable->copy(other.m_storage, m_storage);
+        }
+        /// Relocating never throws: inline callables have to be nothrow movable, and heap ones only hand over a pointer
+        InplaceFunction(InplaceFunction&& other) noexcept : m_vtable(std::exchange(other.m_vtable, nullptr)) {
+            if (m_vtable)
+                m_vtable->relocate(other.m_storage, m_storage);
+        }
+
+        InplaceFunction& operator=(InplaceFunction const& other) {
+            if (this != &other) {
+                reset();
+                if (other.m_vtable)
+                    other.m_vtable->copy(other.m_storage, m_storage);
+                m_vtable = other.m_vtable;
+            }
+            return *this;
+        }
+        InplaceFunction& operator=(InplaceFunction&& other) noexcept {
+            if (this != &other) {
+                reset();
+                if (other.m_vtable)
+                    other.m_vtable->relocate(other.m_storage, m_storage);
+                m_vtable = std::exchange(other.m_vtable, nullptr);
+            }
+            return *this;
+        }
+
+        ~InplaceFunction() {
+            reset();
+        }
+
+        void reset() {
+            if (m_vtable) {
+                m_vtable->destroy(m_storage);
+                m_vtable = nullptr;
+            }
+        }
+
+        explicit operator bool() const {
+            return m_vtable != nullptr;
+        }
+
+        R operator()(Args... args) const {
+            return m_vtable->invoke(const_cast<unsigned char*>(m_storage), std::forward<Args>(args)...);
+        }
+    };
+}
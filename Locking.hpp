@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <type_traits>
+
+namespace cppreactive {
+    /// Locking policy for values that never leave one thread. Every operation is a no-op,
+    /// so nothing is paid for synchronization at all.
+    struct NoLock {
+        void lock() {}
+        bool try_lock() { return true; }
+        void unlock() {}
+
+        void lock_shared() {}
+        bool try_lock_shared() { return true; }
+        void unlock_shared() {}
+    };
+
+    /// Locking policy for short critical sections under little contention. A single byte that spins on a
+    /// plain load before retrying the exchange, and yields to the scheduler while someone else holds it.
+    class SpinLock {
+        std::atomic<bool> m_locked = false;
+     public:
+        void lock() {
+            while (m_locked.exchange(true, std::memory_order_acquire)) {
+                while (m_locked.load(std::memory_order_relaxed))
+                    std::this_thread::yield();
+            }
+        }
+
+        bool try_lock() {
+            return !m_locked.load(std::memory_order_relaxed) && !m_locked.exchange(true, std::memory_order_acquire);
+        }
+
+        void unlock() {
+            m_locked.store(false, std::memory_order_release);
+        }
+    };
+
+    /// `std::mutex` and `std::shared_mutex` are policies as well. With `std::shared_mutex`, reads share the lock.
+    template <typename Lock>
+    concept SharedLockable = requires(Lock& lock) {
+        lock.lock_shared();
+        lock.unlock_shared();
+    };
+
+    /// Guard for read-only access, shared if the policy allows it
+    template <typename Lock>
+    using ReadGuard = std::conditional_t<SharedLockable<Lock>, std::shared_lock<Lock>, std::lock_guard<Lock>>;
+}
@@ -1,7 +1,7 @@
 #pragma once
 
 #include <iostream>
-#include <list>
+#include <algorithm>
 #include <thread>
 #include <vector>
 #include <unordered_set>
@@ -9,7 +9,15 @@
 #include <functional>
 #include <memory>
 #include <type_traits>
+#include <tuple>
+#include <variant>
+#include <stdexcept>
 #include <mutex>
+#include <atomic>
+#include <Locking.hpp>
+#include <cstdint>
+#include <InplaceFunction.hpp>
+#include <utility>
 
 namespace cppreactive {
 
@@ -22,18 +30,501 @@ namespace cppreactive {
         }
     }
 
+    /// Stable handle to a listener, unaffected by other listeners being added or removed
+    struct ListenerHandle {
+        uint64_t id;
+        bool operator==(ListenerHandle const&) const = default;
+    };
+}
+
+template <>
+struct std::hash<cppreactive::ListenerHandle> {
+    size_t operator()(cppreactive::ListenerHandle const& h) const {
+        return std::hash<uint64_t>()(h.id);
+    }
+};
+
+namespace cppreactive {
+    /// Listeners live in a slot table. A handle stores the slot index and the slot's generation, so subscribing and
+    /// unsubscribing are O(1), reuse freed slots without allocating, and stale handles are harmless.
+    ///
+    /// The table is shared as a refcounted snapshot: writers only pin it while notifying, so notifying never copies.
+    /// `react` and `unreact` edit the table in place unless a snapshot is pinned, in which case they copy it first.
+    /// Not synchronized by itself, the owner is expected to guard it with its own lock.
+    template <typename ...Args>
+    class ListenerSet {
+        using Function = InplaceFunction<void(Args const&...)>;
+
+        struct Slot {
+            uint32_t generation = 0;
+            Function fn;
+        };
+
+        struct Table {
+            std::vector<Slot> slots;
+            std::vector<uint32_t> free;
+        };
+
+        std::shared_ptr<Table> m_table;
+
+        Table& writable() {
+            if (!m_table) {
+                m_table = std::make_shared<Table>();
+            } else if (m_table.use_count() > 1) {
+                m_table = std::make_shared<Table>(*m_table);
+            }
+            return *m_table;
+        }
+     public:
+        /// Pinned listener snapshot, safe to notify after the owner's lock has been released
+        class Snapshot {
+            std::shared_ptr<Table const> m_table;
+         public:
+            Snapshot(std::shared_ptr<Table const> table) : m_table(std::move(table)) {}
+
+            void notify(Args const&... args) const {
+                if (!m_table) return;
+                for (auto const& slot : m_table->slots) {
+                    if (slot.fn)
+                        slot.fn(args...);
+                }
+            }
+        };
+
+        Snapshot snapshot() const {
+            return Snapshot(m_table);
+        }
+
+        template <typename F>
+        ListenerHandle react(F&& fn) {
+            auto& table = writable();
+
+            uint32_t index;
+            if (!table.free.empty()) {
+                index = table.free.back();
+                table.free.pop_back();
+            } else {
+                index = static_cast<uint32_t>(table.slots.size());
+                table.slots.emplace_back();
+            }
+
+            auto& slot = table.slots[index];
+            slot.fn = Function(std::forward<F>(fn));
+
+            return { (uint64_t(slot.generation) << 32) | index };
+        }
+
+        void unreact(ListenerHandle it) {
+            if (!m_table) return;
+
+            auto index = static_cast<uint32_t>(it.id);
+            auto generation = static_cast<uint32_t>(it.id >> 32);
+            if (index >= m_table->slots.size() || m_table->slots[index].generation != generation || !m_table->slots[index].fn)
+                return;
+
+            auto& slot = writable().slots[index];
+            slot.fn.reset();
+            ++slot.generation;
+            m_table->free.push_back(index);
+        }
+
+        void clear() {
+            m_table.reset();
+        }
+    };
+
+    template <typename T>
+    constexpr bool isEqualityComparable();
+
+    /// Whether the members of a pair, tuple or variant are comparable. Their `operator==` is unconstrained as well.
+    template <typename T>
+    struct MembersEqualityComparable : std::true_type {};
+    template <typename A, typename B>
+    struct MembersEqualityComparable<std::pair<A, B>> : std::bool_constant<isEqualityComparable<A>() && isEqualityComparable<B>()> {};
+    template <typename ...Ts>
+    struct MembersEqualityComparable<std::tuple<Ts...>> : std::bool_constant<(isEqualityComparable<Ts>() && ...)> {};
+    template <typename ...Ts>
+    struct MembersEqualityComparable<std::variant<Ts...>> : std::bool_constant<(isEqualityComparable<Ts>() && ...)> {};
+
+    template <typename T>
+    constexpr bool isEqualityComparable() {
+        if constexpr (!std::equality_comparable<T>) {
+            return false;
+        } else if constexpr (!MembersEqualityComparable<std::remove_cv_t<T>>::value) {
+            return false;
+        } else if constexpr (requires { typename T::value_type; }) {
+            // Containers declare operator== unconditionally, so check what they hold as well
+            if constexpr (std::is_same_v<typename T::value_type, T>) {
+                return true;
+            } else {
+                return isEqualityComparable<typename T::value_type>();
+            }
+        } else {
+            return true;
+        }
+    }
+
+    /// Default change detection for reactive values. A write comparing equal to the current value
+    /// is suppressed and does not notify. Types without `operator==` always notify.
     template <typename T>
+    struct DefaultEqual {
+        bool operator()(T const& a, T const& b) const {
+            if constexpr (isEqualityComparable<T>()) {
+                return a == b;
+            } else {
+                return false;
+            }
+        }
+    };
+
+    /// Comparator that treats every write as a change, which is how Reactive behaved before change suppression
+    struct NeverEqual {
+        template <typename T>
+        bool operator()(T const&, T const&) const { return false; }
+    };
+
+    inline thread_local size_t s_batchDepth = 0;
+    inline thread_local std::vector<std::function<void()>> s_batchQueue;
+
+    /// Scope that defers listener notifications made on this thread until the outermost Batch is destroyed.
+    /// Values are written immediately, but every reactive written inside the scope notifies its listeners
+    /// only once, with its final value, when the batch flushes. Since observers are scheduled by listeners,
+    /// they are not scheduled before that either.
+    class Batch {
+     public:
+        Batch() { ++s_batchDepth; }
+        Batch(Batch const&) = delete;
+        void operator=(Batch const&) = delete;
+
+        ~Batch() {
+            if (--s_batchDepth != 0)
+                return;
+
+            while (!s_batchQueue.empty()) {
+                auto queue = std::move(s_batchQueue);
+                s_batchQueue.clear();
+
+                for (auto& flush : queue)
+                    flush();
+            }
+        }
+
+        static bool active() {
+            return s_batchDepth != 0;
+        }
+
+        static void defer(std::function<void()> flush) {
+            s_batchQueue.push_back(std::move(flush));
+        }
+    };
+
+    struct ActiveContext {
+        void const* owner;
+        /// The value being dispatched to listeners, or null for a Session
+        void const* value;
+        /// Whether this thread holds the value's lock, as an InplaceSession does
+        bool locked;
+    };
+
+    /// Reactives that are notifying or held by a Session on this thread, innermost last
+    inline thread_local std::vector<ActiveContext> s_activeContexts;
+
+    /// Tracks which values are notifying on the current thread, so a listener writing to the value it listens to can
+    /// be caught with a scan of a short thread-local stack rather than shared bookkeeping under the value's lock.
+    class ContextScope {
+        void const* m_owner;
+
+        static auto find(void const* owner) {
+            return std::find_if(s_activeContexts.rbegin(), s_activeContexts.rend(), [owner](auto const& ctx) { return ctx.owner == owner; });
+        }
+     public:
+        ContextScope(void const* owner, void const* value = nullptr) : m_owner(owner) {
+            enter(owner, value);
+        }
+        ContextScope(ContextScope const&) = delete;
+        ContextScope& operator=(ContextScope const&) = delete;
+
+        ~ContextScope() {
+            leave(m_owner);
+        }
+
+        static bool contains(void const* owner) {
+            return find(owner) != s_activeContexts.rend();
+        }
+
+        /// The value `owner` is currently notifying its listeners with on this thread, if any
+        static void const* value(void const* owner) {
+            auto it = find(owner);
+            return it != s_activeContexts.rend() ? it->value : nullptr;
+        }
+
+        static bool locked(void const* owner) {
+            auto it = find(owner);
+            return it != s_activeContexts.rend() && it->locked;
+        }
+
+        static void enter(void const* owner, void const* value = nullptr, bool locked = false) {
+            s_activeContexts.push_back({ owner, value, locked });
+        }
+
+        /// Sessions don't have to end in the order they started, so this removes the innermost entry rather than the last
+        static void leave(void const* owner) {
+            auto it = find(owner);
+            if (it != s_activeContexts.rend())
+                s_activeContexts.erase(std::next(it).base());
+        }
+    };
+
+    /// Runs `fn` inside a Batch, so everything it writes propagates once it returns
+    template <typename F>
+    decltype(auto) batch(F&& fn) {
+        Batch scope;
+        return std::forward<F>(fn)();
+    }
+
+    /// Listener bookkeeping shared by the reactives that keep their state in a refcounted Core (AtomicReactive,
+    /// SnapshotReactive and SeqlockReactive), so that Refs and deferred batch flushes can outlive them safely.
+    ///
+    /// `Core` derives from it and provides `current()`, called with the lock held, which returns the value to
+    /// notify with as something nullable (an optional or a pointer), empty if there is none anymore. `get()` is
+    /// what Refs read, and defaults to `current()` for cores whose reads don't need the lock.
+    ///
+    /// Cores that write through `publish()` also provide `load()` and `store(value)`, both called with the lock
+    /// held, and a `m_compare` for T. `Stored` is what they hold the value as: T itself, or a pointer to it.
+    template <typename Core, typename T, typename Stored = T>
+    class ListenerCore {
+        static T const& view(Stored const& value) {
+            if constexpr (std::is_same_v<Stored, T>)
+                return value;
+            else
+                return *value;
+        }
+
+        /// Stores `next(load())` and notifies listeners with it, unless it compares equal to what was there
+        template <typename F>
+        void commit(std::shared_ptr<Core> const& self, F&& next) {
+            auto core = static_cast<Core*>(this);
+            std::unique_lock<std::mutex> lock(m_mutex);
+            Stored current = core->load();
+            Stored value = std::forward<F>(next)(current);
+            if (core->m_compare(view(current), view(value)))
+                return;
+
+            core->store(value);
+            if (!deferToBatch(self))
+                notify(lock, view(value));
+        }
+
+        /// Applies writes deferred during a notification pass that just ended, until listeners stop writing back
+        void commitPending(std::shared_ptr<Core> const& self) {
+            while (true) {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                auto pending = std::exchange(m_pending, std::nullopt);
+                lock.unlock();
+
+                if (!pending)
+                    return;
+                commit(self, [&](Stored const&) { return std::move(*pending); });
+            }
+        }
+     public:
+        std::mutex m_mutex;
+        ListenerSet<T> m_listeners;
+        bool m_batched = false;
+        bool m_deferReentrant = false;
+        /// Latest write made from within a listener while reentrant writes are deferred
+        std::optional<Stored> m_pending;
+
+        template <typename F> requires std::invocable<std::decay_t<F>&, T const&>
+        ListenerHandle react(F&& fn) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_listeners.react(std::forward<F>(fn));
+        }
+        void unreact(ListenerHandle it) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_listeners.unreact(it);
+        }
+
+        auto get() {
+            return static_cast<Core*>(this)->current();
+        }
+
+        /// Whether this thread is notifying listeners of this core
+        bool notifying() const {
+            return ContextScope::contains(this);
+        }
+
+        /// Called with the lock held once the value changed. Returns whether an active Batch took over, in which case
+        /// a single `flushBatch()` is queued for its end no matter how often the value changes until then.
+        bool deferToBatch(std::shared_ptr<Core> const& self) {
+            if (!Batch::active())
+                return false;
+
+            if (!std::exchange(m_batched, true)) {
+                Batch::defer([weak = std::weak_ptr<Core>(self)]() {
+                    if (auto core = weak.lock())
+                        core->flushBatch(core);
+                });
+            }
+            return true;
+        }
+
+        /// Called with the lock held. Releases it and notifies listeners with `value`.
+        void notify(std::unique_lock<std::mutex>& lock, T const& value) {
+            auto listeners = m_listeners.snapshot();
+            lock.unlock();
+
+            ContextScope scope(this, &value);
+            listeners.notify(value);
+        }
+
+        void flushBatch(std::shared_ptr<Core> const& self) {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_batched = false;
+            if (auto value = static_cast<Core*>(this)->current()) {
+                notify(lock, *value);
+                // Only cores writing through `publish()` defer reentrant writes
+                if constexpr (requires(Core& core) { core.load(); })
+                    commitPending(self);
+            }
+        }
+
+        void setDeferReentrant(bool defer) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_deferReentrant = defer;
+        }
+
+        /// Stores `next(current)` with the lock held throughout, then notifies listeners unless it compares equal.
+        /// From within a listener, the write is dropped with a warning, or kept as the pending write when reentrant
+        /// writes are deferred, with `next` building on the previous pending write if there is one.
+        template <typename F>
+        void publish(std::shared_ptr<Core> const& self, F&& next) {
+            if (notifying()) {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                if (m_deferReentrant) {
+                    m_pending = std::forward<F>(next)(m_pending ? *m_pending : static_cast<Core*>(this)->load());
+                    return;
+                }
+                lock.unlock();
+                std::cerr << "Attempt to modify value within its own listener!" << std::endl;
+                return;
+            }
+
+            commit(self, std::forward<F>(next));
+            commitPending(self);
+        }
+    };
+
+    /// Non-owning reference to a reactive built on ListenerCore, which scopes reactions like Reactive::Ref. It holds
+    /// the core weakly, so it expires along with the reactive. `Core` provides `set(self, value)` and
+    /// `update(self, fn)`, returning whether the write reached a value, and optionally `version()`.
+    template <typename Core, typename T>
+    class CoreRef {
+        mutable std::mutex m_mutex;
+        std::unordered_set<ListenerHandle> m_listeners;
+        std::weak_ptr<Core> m_core;
+     public:
+        CoreRef() = default;
+        explicit CoreRef(std::weak_ptr<Core> core) : m_core(std::move(core)) {}
+        CoreRef(CoreRef&& r) {
+            std::lock_guard<std::mutex> lock(r.m_mutex);
+
+            m_listeners = std::move(r.m_listeners);
+            m_core = std::move(r.m_core);
+        }
+        CoreRef const& operator=(CoreRef&& r) {
+            std::lock_guard<std::mutex> lock(r.m_mutex);
+
+            m_core = std::move(r.m_core);
+            m_listeners = std::move(r.m_listeners);
+
+            return *this;
+        }
+        /// This is ONLY to make it possible to capture in a std::function. Listeners are not copied over!
+        CoreRef(CoreRef const& r) {
+            std::lock_guard<std::mutex> lock(r.m_mutex);
+            m_core = r.m_core;
+        }
+
+        template <typename F> requires std::invocable<std::decay_t<F>&, T const&>
+        std::optional<ListenerHandle> react(F&& fn) {
+            if (auto core = m_core.lock()) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                auto lis = core->react(std::forward<F>(fn));
+                m_listeners.insert(lis);
+                return lis;
+            }
+            return {};
+        }
+
+        void unreact(ListenerHandle it) {
+            if (auto core = m_core.lock()) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                core->unreact(it);
+                m_listeners.erase(it);
+            }
+        }
+
+        /// The value, or nothing once the reactive is gone
+        auto get() -> decltype(std::declval<Core&>().get()) {
+            if (auto core = m_core.lock())
+                return core->get();
+            return {};
+        }
+
+        std::optional<uint64_t> version() requires requires(Core const& core) { core.version(); } {
+            if (auto core = m_core.lock())
+                return core->version();
+            return {};
+        }
+
+        template <typename Q>
+        CoreRef& operator=(Q&& val) {
+            set(std::forward<Q>(val));
+            return *this;
+        }
+
+        template <typename Q>
+        bool set(Q&& val) {
+            if (auto core = m_core.lock())
+                return core->set(core, std::forward<Q>(val));
+            return false;
+        }
+
+        template <typename F> requires std::convertible_to<std::invoke_result_t<F&, T const&>, T>
+        bool update(F&& fn) {
+            if (auto core = m_core.lock())
+                return core->update(core, fn);
+            return false;
+        }
+
+        std::shared_ptr<Core> parent_lock() {
+            return m_core.lock();
+        }
+
+        CoreRef& ref() { return *this; }
+
+        ~CoreRef() {
+            if (auto core = m_core.lock()) {
+                for (auto const& lis : m_listeners)
+                    core->unreact(lis);
+            }
+        }
+    };
+
+    /// `Lock` is the locking policy guarding the value, its Refs and Sessions. See Locking.hpp for the available ones.
+    template <typename T, typename Compare = DefaultEqual<T>, typename Lock = std::mutex>
     class Reactive {
         /// Weak reference to Reactive class
         class Weak {
          protected:
             Reactive* m_reactive;
-            std::mutex m_mutex;
+            Lock m_mutex;
             friend class Reactive;
 
             struct LockGuard {
                 Reactive* reactive;
-                std::unique_lock<std::mutex> lock;
+                std::unique_lock<Lock> lock;
                 operator bool() const { return reactive != nullptr; }
                 Reactive* operator->() { return reactive; }
             };
@@ -44,7 +535,7 @@ namespace cppreactive {
                 m_reactive->addWeak(this);
             }
             Weak(Weak&& w) {
-                std::lock_guard<std::mutex> lock(w.m_mutex);
+                std::lock_guard<Lock> lock(w.m_mutex);
                 m_reactive = w.m_reactive; 
                 w.m_reactive = nullptr;
 
@@ -54,12 +545,12 @@ namespace cppreactive {
                 }
             }
             LockGuard lock() {
-                std::unique_lock<std::mutex> lock(m_mutex);
+                std::unique_lock<Lock> lock(m_mutex);
                 return LockGuard {m_reactive, std::move(lock)};
             }
 
             ~Weak() {
-                std::lock_guard<std::mutex> lock(m_mutex);
+                std::lock_guard<Lock> lock(m_mutex);
                 if (m_reactive)
                     m_reactive->removeWeak(this);
             }
@@ -67,45 +558,188 @@ namespace cppreactive {
         friend class Weak;
 
         T m_value;
-        std::unordered_set<std::thread::id> m_contexts;
-        std::list<std::function<void(T const&)>> m_listeners;
+        [[no_unique_address]] Compare m_compare;
+        ListenerSet<T> m_listeners;
+        bool m_batched = false;
+        bool m_deferReentrant = false;
+        std::optional<T> m_pending;
+        std::atomic<uint64_t> m_version = 0;
         std::vector<Weak*> m_weaks;
-        mutable std::mutex m_mutex;
+        mutable Lock m_mutex;
 
         void removeWeak(Weak* weak) {
-            std::lock_guard<std::mutex> lock(m_mutex);
+            std::lock_guard<Lock> lock(m_mutex);
 
             auto it = std::remove(m_weaks.begin(), m_weaks.end(), weak);
             m_weaks.erase(it, m_weaks.end());
         }
 
         void addWeak(Weak* weak) {
-            std::lock_guard<std::mutex> lock(m_mutex);
+            std::lock_guard<Lock> lock(m_mutex);
             m_weaks.push_back(weak);
         }
+
+        /// Called with `lock` held once the value changed inside a Batch. Releases it.
+        void queueBatchFlush(std::unique_lock<Lock>& lock) {
+            bool queued = std::exchange(m_batched, true);
+            lock.unlock();
+
+            if (!queued) {
+                Batch::defer([ref = ref()]() mutable {
+                    if (auto guard = ref.parent_lock())
+                        guard->flushBatch();
+                });
+            }
+        }
+
+        /// Locks for a reentrant write, unless this thread already holds the lock through an InplaceSession
+        std::unique_lock<Lock> reentrantLock() {
+            std::unique_lock<Lock> lock(m_mutex, std::defer_lock);
+            if (!ContextScope::locked(this))
+                lock.lock();
+            return lock;
+        }
+
+        /// Handles a write made from within the value's own listener. It is either dropped, or kept as the pending value
+        /// when reentrant writes are deferred, so only the last one survives.
+        template <typename Q>
+        bool deferWrite(Q&& val) {
+            auto lock = reentrantLock();
+            if (!m_deferReentrant) {
+                std::cerr << "Attempt to modify value within its own listener!" << std::endl;
+                return false;
+            }
+
+            m_pending = std::forward<Q>(val);
+            return true;
+        }
+
+        /// Writes `val` and notifies listeners. Expects the reentrancy check to have been done by the caller.
+        template <typename Q>
+        void commit(Q&& val) {
+            if constexpr (!std::is_same_v<std::remove_cvref_t<Q>, T>) {
+                commit(T(std::forward<Q>(val)));
+                return;
+            }
+
+            std::unique_lock<Lock> lock(m_mutex);
+            if (m_compare(m_value, val))
+                return;
+            if (Batch::active()) {
+                m_value = std::forward<Q>(val);
+                bumpVersion();
+                queueBatchFlush(lock);
+                return;
+            }
+            auto listeners = m_listeners.snapshot();
+            lock.unlock();
+
+            {
+                ContextScope scope(this, &val);
+                listeners.notify(val);
+            }
+
+            lock.lock();
+            m_value = std::forward<Q>(val);
+            bumpVersion();
+        }
+
+        /// Applies writes deferred during a notification pass that just ended, until listeners stop writing back
+        void commitPending() {
+            while (true) {
+                m_mutex.lock();
+                auto pending = std::exchange(m_pending, std::nullopt);
+                m_mutex.unlock();
+
+                if (!pending)
+                    return;
+                commit(std::move(*pending));
+            }
+        }
+
+        /// Called with the lock held from within the value's own listener. The value a reentrant change builds on: the
+        /// pending write if there is one, otherwise the value being dispatched.
+        T const& latestValue() const {
+            auto notifying = static_cast<T const*>(ContextScope::value(this));
+            return m_pending ? *m_pending : notifying ? *notifying : m_value;
+        }
+
+        /// Handles an in-place change made from within the value's own listener, see `mutate()`
+        template <typename F>
+        bool deferMutation(F&& fn) {
+            if constexpr (std::is_copy_constructible_v<T>) {
+                auto lock = reentrantLock();
+                if (m_deferReentrant) {
+                    T next = latestValue();
+                    if (lock.owns_lock())
+                        lock.unlock();
+
+                    std::forward<F>(fn)(next);
+                    return deferWrite(std::move(next));
+                }
+            }
+            std::cerr << "Attempt to modify value within its own listener!" << std::endl;
+            return false;
+        }
+
+        /// Called with the lock held whenever the stored value changes
+        void bumpVersion() {
+            m_version.store(m_version.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        /// Called with `lock` held once the stored value changed. Releases it and notifies listeners with `value`.
+        void notifyChanged(std::unique_lock<Lock>& lock, T const& value) {
+            bumpVersion();
+            if (Batch::active()) {
+                queueBatchFlush(lock);
+                return;
+            }
+            auto listeners = m_listeners.snapshot();
+            lock.unlock();
+
+            {
+                ContextScope scope(this, &value);
+                listeners.notify(value);
+            }
+            commitPending();
+        }
+
+        /// Like `notifyChanged()`, but listeners get the stored value itself, which writers on other threads may change
+        /// while they read it. Only for in-place changes, which exist to avoid the copy.
+        void notifyStored(std::unique_lock<Lock>& lock) {
+            notifyChanged(lock, m_value);
+        }
+
+        void flushBatch() {
+            m_mutex.lock();
+            m_batched = false;
+            m_mutex.unlock();
+
+            notify();
+        }
      public:
-        using ListenerIter = typename decltype(m_listeners)::iterator;
+        using ListenerIter = ListenerHandle;
 
         /// Session allows you to obtain a mutable reference to the value while ensuring it properly triggers reactions. 
         /// They provide a thread-safe way to access Reactive, but a Session instance should not be used across threads.
         class Session {
             std::unique_ptr<Weak> m_weak;
             T m_tempVal;
-            Session(std::unique_ptr<Weak>&& w) : m_weak(std::move(w)), m_tempVal(*m_weak->m_reactive) {
-                std::lock_guard<std::mutex> lock(m_weak->m_reactive->m_mutex);
-                m_weak->m_reactive->m_contexts.insert(std::this_thread::get_id());
+            void const* m_context;
+            Session(std::unique_ptr<Weak>&& w) : m_weak(std::move(w)), m_tempVal(*m_weak->m_reactive), m_context(m_weak->m_reactive) {
+                ContextScope::enter(m_context);
             }
             friend class Reactive;
          public:
             Session(Session const&) = delete;
             void operator=(Session const&) = delete;
-            Session(Session&& g) : m_weak(std::move(g.m_weak)), m_tempVal(std::move(g.m_tempVal)) {}
+            Session(Session&& g) : m_weak(std::move(g.m_weak)), m_tempVal(std::move(g.m_tempVal)), m_context(std::exchange(g.m_context, nullptr)) {}
 
             T operator->() requires std::is_pointer_v<T> { return m_tempVal; }
             T* operator->() requires (!std::is_pointer_v<T>) { return &m_tempVal; }
             T& operator*() { return m_tempVal; }
             void operator=(T const& t) { m_tempVal = t; }
-            void operator=(T&& t) { m_tempVal = t; }
+            void operator=(T&& t) { m_tempVal = std::move(t); }
 
             operator T() const {
                 return m_tempVal;
@@ -113,41 +747,88 @@ namespace cppreactive {
 
             ~Session() {
                 if (!m_weak) return;
+                ContextScope::leave(m_context);
                 if (auto guard = m_weak->lock()) {
-                    guard->m_mutex.lock();
-                    guard->m_contexts.erase(std::this_thread::get_id());
-                    guard->m_mutex.unlock();
-
                     guard->removeWeak(&*m_weak);
-                    guard->set(m_tempVal);
+                    guard->set(std::move(m_tempVal));
                 }
             }
         };
         friend class Session;
 
-        /// Ref is a way to scope reactions and obtain a non-owning reference to a Reactive class that guarantees memory safety
-        class Ref {
-            struct _list_iterator_hash {
-                size_t operator()(ListenerIter const& i) const {
-                    return std::hash<decltype(&*i)>()(&*i);
+        /// Like Session, but edits the stored value directly instead of a copy. It holds the write lock for as long
+        /// as it lives and notifies listeners with the edited value once destroyed, so nothing is ever copied.
+        ///
+        /// IMPORTANT: InplaceSession is SINGLE-WRITER. Listeners get the stored value itself once the lock is released,
+        /// so a write from another thread at the same time (another InplaceSession, `set()`, `update()`...) can
+        /// change or destroy it while they read it. Only use it on a Reactive written from one thread at a time, and
+        /// use a Session or `update()` otherwise, whose listeners get a copy.
+        ///
+        /// Since the lock is held, the session has to be short-lived and must not outlive the Reactive, and the
+        /// owning thread must not read the Reactive while it is open. Writes to it from that thread are treated as
+        /// reentrant. Other threads block until the session ends. Listeners are always notified, even if nothing
+        /// was changed.
+        ///
+        /// Opened from within the value's own listener, it edits a copy that is handled like any other reentrant
+        /// write. Values that can't be copied throw `std::logic_error` there instead, since there is nothing to edit.
+        class InplaceSession {
+            Reactive* m_reactive;
+            /// Only used when opened from within the value's own listener, where the value can't be edited in place
+            std::optional<T> m_detached;
+
+            InplaceSession(Reactive& reactive) : m_reactive(&reactive) {
+                if (ContextScope::contains(m_reactive)) {
+                    if constexpr (std::is_copy_constructible_v<T>) {
+                        auto lock = m_reactive->reentrantLock();
+                        m_detached.emplace(m_reactive->latestValue());
+                    } else {
+                        throw std::logic_error("Attempt to modify value within its own listener, which can't be copied");
+                    }
+                } else {
+                    m_reactive->m_mutex.lock();
                 }
-            };
+                ContextScope::enter(m_reactive, nullptr, !m_detached);
+            }
+            friend class Reactive;
+         public:
+            InplaceSession(InplaceSession const&) = delete;
+            void operator=(InplaceSession const&) = delete;
+
+            T operator->() requires std::is_pointer_v<T> { return **this; }
+            T* operator->() requires (!std::is_pointer_v<T>) { return &**this; }
+            T& operator*() { return m_detached ? *m_detached : m_reactive->m_value; }
+            void operator=(T const& t) { **this = t; }
+            void operator=(T&& t) { **this = std::move(t); }
+
+            ~InplaceSession() {
+                ContextScope::leave(m_reactive);
+                if (m_detached) {
+                    m_reactive->deferWrite(std::move(*m_detached));
+                    return;
+                }
+                std::unique_lock<Lock> lock(m_reactive->m_mutex, std::adopt_lock);
+                m_reactive->notifyStored(lock);
+            }
+        };
+        friend class InplaceSession;
 
-            mutable std::mutex m_mutex;
-            std::unordered_set<ListenerIter, _list_iterator_hash> m_listeners;
+        /// Ref is a way to scope reactions and obtain a non-owning reference to a Reactive class that guarantees memory safety
+        class Ref {
+            mutable Lock m_mutex;
+            std::unordered_set<ListenerIter> m_listeners;
             std::unique_ptr<Weak> m_weak;
             Ref(std::unique_ptr<Weak>&& w) : m_weak(std::move(w)) {}
             friend class Reactive;
          public:
             Ref(Ref&& r) {
-                std::lock_guard<std::mutex> lock(r.m_mutex);
+                std::lock_guard<Lock> lock(r.m_mutex);
             
                 m_listeners = std::move(r.m_listeners);
                 m_weak = std::move(r.m_weak);
             }
             Ref() = default;
             Ref const& operator=(Ref&& r) {
-                std::lock_guard<std::mutex> lock(r.m_mutex);
+                std::lock_guard<Lock> lock(r.m_mutex);
 
                 m_weak = std::move(r.m_weak);
                 m_listeners = std::move(r.m_listeners);
@@ -156,7 +837,7 @@ namespace cppreactive {
             }
             /// This is ONLY to make it possible to capture in a std::function. Listeners are not copied over!
             Ref(Ref const& r) {
-                std::lock_guard<std::mutex> lock(r.m_mutex);
+                std::lock_guard<Lock> lock(r.m_mutex);
 
                 if (auto guard = r.m_weak->lock()) {
                     m_weak = std::make_unique<Weak>(*guard.reactive);
@@ -165,10 +846,11 @@ namespace cppreactive {
                 }
             }
 
-            std::optional<ListenerIter> react(std::function<void(T const&)> fn) {
+            template <typename F> requires std::invocable<std::decay_t<F>&, T const&>
+            std::optional<ListenerIter> react(F&& fn) {
                 if (auto guard = m_weak->lock()) {
-                    std::lock_guard<std::mutex> lock(m_mutex);
-                    auto lis = guard->react(fn);
+                    std::lock_guard<Lock> lock(m_mutex);
+                    auto lis = guard->react(std::forward<F>(fn));
                     m_listeners.insert(lis);
                     return lis;
                 }
@@ -177,7 +859,7 @@ namespace cppreactive {
 
             void unreact(ListenerIter it) {
                 if (auto guard = m_weak->lock()) {
-                    std::lock_guard<std::mutex> lock(m_mutex);
+                    std::lock_guard<Lock> lock(m_mutex);
                     guard->unreact(it);
                     m_listeners.erase(it);
                 }
@@ -190,6 +872,13 @@ namespace cppreactive {
                 return {};
             }
 
+            std::optional<uint64_t> version() {
+                if (auto guard = m_weak->lock()) {
+                    return guard->version();
+                }
+                return {};
+            }
+
             template <typename Q>
             Ref& operator=(Q&& val) {
                 set(std::forward<Q>(val));
@@ -199,7 +888,16 @@ namespace cppreactive {
             template <typename Q>
             bool set(Q&& val) {
                 if (auto guard = m_weak->lock()) {
-                    guard->set(val);
+                    guard->set(std::forward<Q>(val));
+                    return true;
+                }
+                return false;
+            }
+
+            template <typename F> requires std::convertible_to<std::invoke_result_t<F&, T const&>, T>
+            bool update(F&& fn) {
+                if (auto guard = m_weak->lock()) {
+                    guard->update(std::forward<F>(fn));
                     return true;
                 }
                 return false;
@@ -231,14 +929,12 @@ namespace cppreactive {
         Reactive(T const& initial) : m_value(initial) {}
         Reactive() requires std::is_default_constructible_v<T> : m_value() {}
         Reactive(T&& initial) : m_value(std::move(initial)) {}
-        Reactive(Reactive const& other) : m_value(other.m_value) {
-            std::lock_guard<std::mutex> lock(m_mutex);
-            m_value = other.m_value;
-        }
-        Reactive(Reactive&& other) {
-            std::lock_guard<std::mutex> lock(m_mutex);
+        Reactive(Reactive const& other) : m_value(static_cast<T>(other)), m_compare(other.m_compare), m_deferReentrant(other.m_deferReentrant) {}
+        Reactive(Reactive&& other) : m_compare(other.m_compare), m_deferReentrant(other.m_deferReentrant) {
+            std::lock_guard<Lock> lock(m_mutex);
             m_value = std::move(other.m_value);
-            m_contexts = std::move(other.m_contexts);
+            m_pending = std::move(other.m_pending);
+            m_version = other.m_version.load();
             m_listeners = std::move(other.m_listeners);
             m_weaks = std::move(other.m_weaks);
 
@@ -246,16 +942,16 @@ namespace cppreactive {
             other.m_listeners.clear();
 
             for (auto& ref : m_weaks) {
-                std::lock_guard<std::mutex> lock(ref->m_mutex);
+                std::lock_guard<Lock> lock(ref->m_mutex);
                 ref->m_reactive = this;
             }
         }
 
         ~Reactive() {
-            std::lock_guard<std::mutex> lock(m_mutex);
+            std::lock_guard<Lock> lock(m_mutex);
 
             for (auto& ref : m_weaks) {
-                std::lock_guard<std::mutex> lock(ref->m_mutex);
+                std::lock_guard<Lock> lock(ref->m_mutex);
                 ref->m_reactive = nullptr;
             }
         }
@@ -263,62 +959,79 @@ namespace cppreactive {
 
         template <typename Q> // Must do this or else it won't be a forwarding ref
         void set(Q&& val) {
-            m_mutex.lock();
-
-            auto this_id = std::this_thread::get_id();
-
-            if (m_contexts.contains(this_id)) {
-                std::cerr << "Attempt to modify value within its own listener!" << std::endl;
-                m_mutex.unlock();
+            if (ContextScope::contains(this)) {
+                deferWrite(std::forward<Q>(val));
                 return;
             }
-            m_contexts.insert(this_id);
-            auto copy = m_listeners;
-            m_mutex.unlock();
-
-            for (auto const& fn : copy)
-                fn(val);
 
-            m_mutex.lock();
-            m_value = std::forward<Q>(val);
-            m_contexts.erase(this_id);
-            m_mutex.unlock();
+            commit(std::forward<Q>(val));
+            commitPending();
         }
 
         T const& get() const {
-            std::lock_guard<std::mutex> lock(m_mutex);
+            ReadGuard<Lock> lock(m_mutex);
             return m_value;
         }
 
+        /// Invokes every listener with the current value without changing it
+        void notify() {
+            if (ContextScope::contains(this))
+                return;
+
+            m_mutex.lock();
+            auto listeners = m_listeners.snapshot();
+            // Copied so that writers on other threads can't change it while listeners read it
+            std::conditional_t<std::is_copy_constructible_v<T>, T, T const&> value = m_value;
+            m_mutex.unlock();
+
+            {
+                ContextScope scope(this, &value);
+                listeners.notify(value);
+            }
+            commitPending();
+        }
+
         template <typename Q>
-        Reactive<T>& operator=(Q&& val) {
+        Reactive& operator=(Q&& val) {
             set(std::forward<Q>(val));
             return *this;
         }
 
 
-        Reactive<T>& operator=(Reactive<T> const& val) {
-            set(*val);
+        Reactive& operator=(Reactive const& val) {
+            set(val.get());
             return *this;
         }
         operator T() const {
-            std::lock_guard<std::mutex> lock(m_mutex);
+            ReadGuard<Lock> lock(m_mutex);
             return m_value;
         }
 
-        ListenerIter react(std::function<void(T const&)> fn) {
-            std::lock_guard<std::mutex> lock(m_mutex);
-            m_listeners.push_back(fn);
-            return --m_listeners.end();
+        template <typename F> requires std::invocable<std::decay_t<F>&, T const&>
+        ListenerIter react(F&& fn) {
+            std::lock_guard<Lock> lock(m_mutex);
+            return m_listeners.react(std::forward<F>(fn));
         }
         void unreact(ListenerIter it) {
-            std::lock_guard<std::mutex> lock(m_mutex);
-            m_listeners.erase(it);
+            std::lock_guard<Lock> lock(m_mutex);
+            m_listeners.unreact(it);
+        }
+
+        /// Starts at 0 and goes up by one every time the stored value changes. Reading it never locks, so a poller can
+        /// tell whether anything changed since it last looked with a single integer compare.
+        uint64_t version() const {
+            return m_version.load(std::memory_order_acquire);
         }
 
         bool isInContext() const {
-            std::lock_guard<std::mutex> lock(m_mutex);
-            return m_contexts.contains(std::this_thread::get_id());
+            return ContextScope::contains(this);
+        }
+
+        /// By default a write made from within the value's own listener is dropped with a warning. When deferred, it is
+        /// applied once the current notification pass is over instead. Several such writes coalesce into the last one.
+        void setDeferReentrant(bool defer) {
+            std::lock_guard<Lock> lock(m_mutex);
+            m_deferReentrant = defer;
         }
 
         Session session() requires std::is_copy_constructible_v<T> {
@@ -328,12 +1041,42 @@ namespace cppreactive {
             return Ref(std::make_unique<Weak>(Weak(*this)));
         }
 
-        Reactive operator++() {
-            set(get() + 1);
+        /// Single-writer only, see InplaceSession. Throws `std::logic_error` if T can't be copied and this thread is
+        /// notifying this Reactive's listeners.
+        InplaceSession inplaceSession() {
+            return InplaceSession(*this);
+        }
+
+        /// Replaces the value with `fn(value)` within a single critical section, so concurrent updates never lose
+        /// each other's writes, then notifies once. Unlike `set()`, the new value is stored before listeners run.
+        /// Listeners get their own copy of it, unless T can't be copied.
+        /// `fn` runs with the lock held and must not access this Reactive itself.
+        template <typename F> requires std::convertible_to<std::invoke_result_t<F&, T const&>, T>
+        void update(F&& fn) {
+            if (ContextScope::contains(this)) {
+                deferMutation([&](T& value) { value = fn(std::as_const(value)); });
+                return;
+            }
+
+            std::unique_lock<Lock> lock(m_mutex);
+            T next = fn(std::as_const(m_value));
+            if (m_compare(m_value, next))
+                return;
+            if constexpr (std::is_copy_constructible_v<T>) {
+                m_value = next;
+                notifyChanged(lock, next);
+            } else {
+                m_value = std::move(next);
+                notifyStored(lock);
+            }
+        }
+
+        Reactive& operator++() {
+            update([](T const& value) { return value + 1; });
             return *this;
         }
-        Reactive operator--() {
-            set(get() - 1);
+        Reactive& operator--() {
+            update([](T const& value) { return value - 1; });
             return *this;
         }
 
@@ -349,9 +1092,26 @@ namespace cppreactive {
         template <typename Q> T operator+() const { return +get(); }
         template <typename Q> T operator~() { return ~get(); }
 
+     protected:
+        /// Changes the stored value in place with the lock held, then notifies listeners with it. Nothing is copied,
+        /// so listeners get the stored value itself after the lock is released, and a write from another thread can
+        /// change it while they read it. Only safe for a single writer; types built on this must say so.
+        /// Returns false if the write was dropped for happening within the value's own listener. When reentrant writes
+        /// are deferred, `fn` is applied to a copy of the latest value which then becomes the pending write.
+        template <typename F>
+        bool mutate(F&& fn) {
+            if (ContextScope::contains(this))
+                return deferMutation(std::forward<F>(fn));
+
+            std::unique_lock<Lock> lock(m_mutex);
+            std::forward<F>(fn)(m_value);
+            notifyStored(lock);
+            return true;
+        }
+
 
     };
 
-    template <typename T>
-    using ReactiveRef = typename Reactive<T>::Ref;
+    template <typename T, typename Compare = DefaultEqual<T>, typename Lock = std::mutex>
+    using ReactiveRef = typename Reactive<T, Compare, Lock>::Ref;
 }
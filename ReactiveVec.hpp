@@ -1,22 +1,90 @@
+#pragma once
+
 #include <vector>
 #include <Reactive.hpp>
 #include <Signal.hpp>
 
 namespace cppreactive {
-	template <typename T>
-	class ReactiveVec : public Reactive<std::vector<T>> {
+	/// Describes a single change to a ReactiveVec, so listeners can follow along without diffing the whole vector
+	struct VecPatch {
+	    enum Kind {
+	        /// `count` elements were inserted at `index`
+	        Insert,
+	        /// `count` elements were erased starting at `index`
+	        Erase,
+	        /// The element at `index` was assigned
+	        Assign,
+	        /// All `count` elements were removed
+	        Clear,
+	        /// The vector grew or shrank by `count` elements at `index`, its smaller size
+	        Resize,
+	        /// The whole vector was replaced, for example by `set()` or a Session. `count` is the new size.
+	        Replace,
+	    };
+
+	    Kind kind;
+	    size_t index;
+	    size_t count;
+
+	    bool operator==(VecPatch const&) const = default;
+	};
+
+	/// Reactive vector whose mutations (`push_back()`, `insert()`, `erase()`...) edit the stored vector in place and
+	/// report what they changed to `reactPatch()` listeners.
+	///
+	/// IMPORTANT: ReactiveVec is SINGLE-WRITER. To avoid copying the vector, listeners and patch listeners of those
+	/// mutations get the stored vector itself once the lock is released, so a mutation from another thread at the
+	/// same time can reallocate it while they read it. Mutate it from one thread at a time. `set()`, `update()` and
+	/// Sessions are safe from any thread, since their listeners get a copy.
+	template <typename T, typename Lock = std::mutex>
+	class ReactiveVec : public Reactive<std::vector<T>, DefaultEqual<std::vector<T>>, Lock> {
+	    using Base = Reactive<std::vector<T>, DefaultEqual<std::vector<T>>, Lock>;
+
+	    /// Patch listeners are fed by a regular listener on the vector. Mutations leave their patch here right before
+	    /// notifying, and anything that arrives without one (`set()`, Sessions, batches) is reported as a Replace.
+	    struct PatchChannel {
+	        Lock m_mutex;
+	        ListenerSet<VecPatch, std::vector<T>> m_listeners;
+	        std::atomic<bool> m_listening = false;
+	    };
+
+	    static inline thread_local std::optional<std::pair<PatchChannel const*, VecPatch>> s_pendingPatch;
+
+	    std::shared_ptr<PatchChannel> m_channel = std::make_shared<PatchChannel>();
+
+	    /// Applies `fn` in place and reports the patch it returns to patch listeners, without copying the vector
+	    template <typename F>
+	    bool apply(F&& fn) {
+	        auto applied = this->mutate([&](std::vector<T>& vec) {
+	            VecPatch patch = std::forward<F>(fn)(vec);
+	            if (m_channel->m_listening && !Batch::active())
+	                s_pendingPatch.emplace(m_channel.get(), patch);
+	        });
+	        s_pendingPatch.reset();
+	        return applied;
+	    }
 	 public:
-	    using Reactive<std::vector<T>>::Reactive;
+	    using Base::Base;
+	    using Base::operator=;
+
+	    ReactiveVec(ReactiveVec const& other) : Base(other) {}
+	    ReactiveVec(ReactiveVec&& other) = default;
+
+	    ReactiveVec& operator=(ReactiveVec const& other) {
+	        this->set(other.get());
+	        return *this;
+	    }
 
 	    struct Setter {
-	        ReactiveVec::Ref ref;
+	        typename Base::Ref ref;
 	        T value;
 	        size_t idx;
 
 	        template <std::convertible_to<T> Q>
 	        void operator=(Q&& value) {
-	            if (auto ses = ref.session()) {
-	                (*ses)->at(idx) = std::forward<Q>(value);
+	            // Refs only ever come from a ReactiveVec here
+	            if (auto guard = ref.parent_lock()) {
+	                static_cast<ReactiveVec*>(guard.reactive)->assign(idx, std::forward<Q>(value));
 	            }
 	        }
 
@@ -25,34 +93,110 @@ namespace cppreactive {
 	        }
 	    };
 
+	    /// Listens to the individual changes made to the vector. Listeners get the patch and the vector after it was applied.
+	    template <typename F> requires std::invocable<std::decay_t<F>&, VecPatch const&, std::vector<T> const&>
+	    ListenerHandle reactPatch(F&& fn) {
+	        std::lock_guard<Lock> lock(m_channel->m_mutex);
+
+	        if (!m_channel->m_listening) {
+	            this->react([channel = m_channel](std::vector<T> const& vec) {
+	                VecPatch patch { VecPatch::Replace, 0, vec.size() };
+	                if (s_pendingPatch && s_pendingPatch->first == channel.get()) {
+	                    patch = s_pendingPatch->second;
+	                    s_pendingPatch.reset();
+	                }
+
+	                channel->m_mutex.lock();
+	                auto listeners = channel->m_listeners.snapshot();
+	                channel->m_mutex.unlock();
+
+	                listeners.notify(patch, vec);
+	            });
+	            m_channel->m_listening = true;
+	        }
+
+	        return m_channel->m_listeners.react(std::forward<F>(fn));
+	    }
+
+	    void unreactPatch(ListenerHandle it) {
+	        std::lock_guard<Lock> lock(m_channel->m_mutex);
+	        m_channel->m_listeners.unreact(it);
+	    }
+
 	    template <std::convertible_to<T> Q>
 	    void push_back(Q&& value) {
-	        this->session()->push_back(std::forward<Q>(value));
+	        apply([&](std::vector<T>& vec) -> VecPatch {
+	            vec.push_back(std::forward<Q>(value));
+	            return { VecPatch::Insert, vec.size() - 1, 1 };
+	        });
 	    }
 
 	    template <typename ...Args>
-	    void emplace_back(Args... args) {
-	        this->session()->emplace_back(args...);
+	    void emplace_back(Args&&... args) {
+	        apply([&](std::vector<T>& vec) -> VecPatch {
+	            vec.emplace_back(std::forward<Args>(args)...);
+	            return { VecPatch::Insert, vec.size() - 1, 1 };
+	        });
 	    }
 
-	    T pop_back() {
-	        return this->session()->pop_back();
+	    /// Removes and returns the last element. Returns nothing if the vector is empty, or if the write was dropped for
+	    /// happening within the vector's own listener.
+	    std::optional<T> pop_back() {
+	        if (this->empty())
+	            return {};
+
+	        std::optional<T> popped;
+	        apply([&](std::vector<T>& vec) -> VecPatch {
+	            // A deferred write works on the latest value, which may have been emptied meanwhile
+	            if (vec.empty())
+	                return { VecPatch::Erase, 0, 0 };
+
+	            popped.emplace(std::move(vec.back()));
+	            vec.pop_back();
+	            return { VecPatch::Erase, vec.size(), 1 };
+	        });
+	        return popped;
 	    }
 
 	    template <std::convertible_to<T> Q>
 	    void insert(size_t index, Q&& value) {
-	        this->session()->insert(this->get().begin() + index, std::forward<Q>(value));
+	        apply([&](std::vector<T>& vec) -> VecPatch {
+	            vec.insert(vec.begin() + index, std::forward<Q>(value));
+	            return { VecPatch::Insert, index, 1 };
+	        });
+	    }
+
+	    /// Assigns a single element. Assigning a value equal to the current one is suppressed.
+	    template <std::convertible_to<T> Q>
+	    void assign(size_t index, Q&& value) {
+	        if (DefaultEqual<T>()(this->get().at(index), value))
+	            return;
+
+	        apply([&](std::vector<T>& vec) -> VecPatch {
+	            vec.at(index) = std::forward<Q>(value);
+	            return { VecPatch::Assign, index, 1 };
+	        });
 	    }
 
 	    void erase(size_t index) {
-	        this->session()->erase(this->get().begin() + index);
+	        apply([&](std::vector<T>& vec) -> VecPatch {
+	            vec.erase(vec.begin() + index);
+	            return { VecPatch::Erase, index, 1 };
+	        });
 	    }
 	    void erase(size_t start, size_t end) {
-	        this->session()->erase(this->get().begin() + start, this->get().begin() + end);
+	        apply([&](std::vector<T>& vec) -> VecPatch {
+	            vec.erase(vec.begin() + start, vec.begin() + end);
+	            return { VecPatch::Erase, start, end - start };
+	        });
 	    }
 
 	    void clear() {
-	        this->session()->clear();
+	        apply([&](std::vector<T>& vec) -> VecPatch {
+	            auto count = vec.size();
+	            vec.clear();
+	            return { VecPatch::Clear, 0, count };
+	        });
 	    }
 
 	    size_t size() const {
@@ -72,7 +216,11 @@ namespace cppreactive {
 	    }
 
 	    void resize(size_t newSize) {
-	        this->session()->resize(newSize);
+	        apply([&](std::vector<T>& vec) -> VecPatch {
+	            auto oldSize = vec.size();
+	            vec.resize(newSize);
+	            return { VecPatch::Resize, std::min(oldSize, newSize), std::max(oldSize, newSize) - std::min(oldSize, newSize) };
+	        });
 	    }
 
 	    decltype(auto) begin() const {
@@ -89,14 +237,14 @@ namespace cppreactive {
 	    }
 	};
 
-	template <typename T>
-	class Signal<std::vector<T>> : public SignalBase<ReactiveVec<T>> {
+	template <typename T, typename Lock>
+	class Signal<std::vector<T>, DefaultEqual<std::vector<T>>, Lock> : public SignalBase<ReactiveVec<T, Lock>> {
 	 public:
-	    using SignalBase<ReactiveVec<T>>::SignalBase;
+	    using SignalBase<ReactiveVec<T, Lock>>::SignalBase;
 
 	    template <std::convertible_to<std::vector<T>> Q>
-	    Signal(Q&& value) : SignalBase<ReactiveVec<T>>(ReactiveVec<T>(value)) {}
+	    Signal(Q&& value) : SignalBase<ReactiveVec<T, Lock>>(ReactiveVec<T, Lock>(value)) {}
 
-	    bool operator==(const Signal&) const = default; 
+	    bool operator==(const Signal&) const = default;
 	};
 }
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <Reactive.hpp>
+#include <Signal.hpp>
+
+namespace cppreactive {
+    template <typename T>
+    concept SeqlockReactiveValue = std::is_trivially_copyable_v<T>;
+
+    /// Reactive for medium-sized trivially copyable values, such as a pose struct, read by many threads and
+    /// written by few.
+    ///
+    /// Reads are seqlock reads: they copy the value out and retry if a write happened meanwhile, so readers never
+    /// write to shared memory and never contend with each other. Writes are serialized by a mutex and bump the
+    /// sequence around the copy, then notify listeners with the value they wrote.
+    ///
+    /// Prefer AtomicReactive for values that fit in a lock-free atomic, and SnapshotReactive for large ones.
+    template <SeqlockReactiveValue T, typename Compare = DefaultEqual<T>>
+    class SeqlockReactive {
+        static constexpr size_t s_words = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+        using Words = std::array<uint64_t, s_words>;
+
+        /// Owned by the SeqlockReactive alone, Refs only hold it weakly
+        struct Core : ListenerCore<Core, T> {
+            /// Written only by writers, on its own cache line so that listener bookkeeping doesn't disturb readers
+            alignas(64) std::atomic<uint64_t> m_sequence = 0;
+            std::array<std::atomic<uint64_t>, s_words> m_words;
+
+            [[no_unique_address]] Compare m_compare;
+
+            Core(T const& value, Compare compare) : m_compare(std::move(compare)) {
+                Words words {};
+                std::memcpy(words.data(), &value, sizeof(T));
+                for (size_t i = 0; i < s_words; ++i)
+                    m_words[i].store(words[i], std::memory_order_relaxed);
+            }
+
+            T load() const {
+                Words words;
+                while (true) {
+                    auto sequence = m_sequence.load(std::memory_order_acquire);
+                    if (sequence & 1) {
+                        std::this_thread::yield();
+                        continue;
+                    }
+
+                    for (size_t i = 0; i < s_words; ++i)
+                        words[i] = m_words[i].load(std::memory_order_relaxed);
+
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                    if (m_sequence.load(std::memory_order_relaxed) == sequence)
+                        break;
+                }
+
+                std::array<unsigned char, sizeof(T)> bytes;
+                std::memcpy(bytes.data(), words.data(), sizeof(T));
+                return std::bit_cast<T>(bytes);
+            }
+
+            /// Called with the lock held
+            void store(T const& value) {
+                Words words {};
+                std::memcpy(words.data(), &value, sizeof(T));
+
+                auto sequence = m_sequence.load(std::memory_order_relaxed);
+                m_sequence.store(sequence + 1, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_release);
+
+                for (size_t i = 0; i < s_words; ++i)
+                    m_words[i].store(words[i], std::memory_order_relaxed);
+
+                m_sequence.store(sequence + 2, std::memory_order_release);
+            }
+
+            std::optional<T> current() const {
+                return load();
+            }
+
+            uint64_t version() const {
+                return m_sequence.load(std::memory_order_acquire) / 2;
+            }
+
+            template <typename Q>
+            bool set(std::shared_ptr<Core> const& self, Q&& val) {
+                this->publish(self, [value = T(std::forward<Q>(val))](T const&) { return value; });
+                return true;
+            }
+
+            template <typename F>
+            bool update(std::shared_ptr<Core> const& self, F& fn) {
+                this->publish(self, [&](T const& current) -> T { return fn(current); });
+                return true;
+            }
+        };
+
+        std::shared_ptr<Core> m_core;
+     public:
+        using ListenerIter = ListenerHandle;
+        using Ref = CoreRef<Core, T>;
+
+        SeqlockReactive() requires std::is_default_constructible_v<T> : SeqlockReactive(T()) {}
+        SeqlockReactive(T const& initial) : m_core(std::make_shared<Core>(initial, Compare())) {}
+        SeqlockReactive(SeqlockReactive const& other) : m_core(std::make_shared<Core>(other.get(), other.m_core->m_compare)) {}
+        SeqlockReactive(SeqlockReactive&& other) : m_core(std::exchange(other.m_core, nullptr)) {}
+
+        template <typename Q>
+        void set(Q&& val) {
+            m_core->set(m_core, std::forward<Q>(val));
+        }
+
+        /// Stores `fn(value)` with the writer lock held, so concurrent updates never lose each other's writes.
+        /// `fn` must not write to this SeqlockReactive itself.
+        template <typename F> requires std::convertible_to<std::invoke_result_t<F&, T const&>, T>
+        void update(F&& fn) {
+            m_core->update(m_core, fn);
+        }
+
+        /// Copies the value out without writing to shared memory, retrying while a write is in progress
+        T get() const {
+            return m_core->load();
+        }
+
+        template <typename Q>
+        SeqlockReactive& operator=(Q&& val) {
+            set(std::forward<Q>(val));
+            return *this;
+        }
+
+        SeqlockReactive& operator=(SeqlockReactive const& val) {
+            set(val.get());
+            return *this;
+        }
+        operator T() const {
+            return get();
+        }
+
+        template <typename F> requires std::invocable<std::decay_t<F>&, T const&>
+        ListenerIter react(F&& fn) {
+            return m_core->react(std::forward<F>(fn));
+        }
+        void unreact(ListenerIter it) {
+            m_core->unreact(it);
+        }
+
+        /// Goes up by one every time the value changes. It is the sequence readers check anyway, so it costs nothing extra.
+        uint64_t version() const {
+            return m_core->version();
+        }
+
+        bool isInContext() const {
+            return m_core->notifying();
+        }
+
+        /// Like `Reactive::setDeferReentrant()`: a write made from within the value's own listener is dropped with a
+        /// warning by default, and applied once the current notification pass is over when deferred. Several such
+        /// writes coalesce into the last one.
+        void setDeferReentrant(bool defer) {
+            m_core->setDeferReentrant(defer);
+        }
+
+        Ref ref() {
+            return Ref(m_core);
+        }
+    };
+
+    template <SeqlockReactiveValue T, typename Compare = DefaultEqual<T>>
+    class SeqlockSignal : public SignalBase<SeqlockReactive<T, Compare>> {
+        using SignalBase<SeqlockReactive<T, Compare>>::SignalBase;
+     public:
+
+        template <std::convertible_to<T> Q>
+        SeqlockSignal(Q&& value) : SignalBase<SeqlockReactive<T, Compare>>(SeqlockReactive<T, Compare>(static_cast<T>(value))) {}
+    };
+}
@@ -2,6 +2,10 @@
 
 #include <Reactive.hpp>
 #include <functional>
+#include <atomic>
+#include <chrono>
+#include <queue>
+#include <utility>
 
 #if defined(_WIN32) && !defined(__CYGWIN__)
     #ifdef CPP_REACTIVE_EXPORT
@@ -19,16 +23,48 @@
     #endif
 #endif
 
+/// Lock held by `update()`, each observer and Observatory. It is part of the library's layout,
+/// so it has to be the same for lib.cpp and everything including this header. Set it through CMake.
+#ifndef CPP_REACTIVE_OBSERVER_LOCK
+    #define CPP_REACTIVE_OBSERVER_LOCK std::mutex
+#endif
+
 namespace cppreactive {
     struct Observer;
+    struct UpdatePool;
+
+    using ObserverLock = CPP_REACTIVE_OBSERVER_LOCK;
+
+    /// Link in the queue of scheduled observers. Every Observer is one, so scheduling never allocates.
+    struct ScheduleNode {
+        std::atomic<ScheduleNode*> m_next = nullptr;
+    };
 
     /**
      * Singleton to manage the stack of active and scheduled observers. Only accessed
      * via pointer, so any changes to the underlying structure do not break ABI.
      * 
+     * The stack of active observers is kept per thread, so tracked reads on different threads
+     * never contend. Only the queue of scheduled observers is shared, and it is lock-free: threads
+     * scheduling observers never wait on each other or on `update()`.
+     * 
      * IMPORTANT: The `update()` function needs to be called by the user. This implementation
      * of signals makes no opinion on how you schedule observations, but it must be done
-     * manually and outside of the Signal reaction for safety purposes.
+     * manually and outside of the Signal reaction for safety purposes. To avoid polling,
+     * `setWakeup()` or `wakeupFd()` tell an event loop when there is something to update.
+     * 
+     * Every observer carries a level: one more than the level of any observer that computes or
+     * has written to a signal it depends on. `update()` drains scheduled observers lowest level first, so in
+     * a diamond (A -> B, A -> C, B + C -> D) D only runs after both B and C have settled.
+     * Scheduling is idempotent, so an observer is queued at most once no matter how many
+     * of its signals change before it runs.
+     * 
+     * With `setParallelism()` every level is spread across a pool of worker threads instead, and the
+     * next level only starts once the whole previous one has finished. Observers on the same level
+     * are independent as far as ComputedSignal goes, since readers are placed above it from their
+     * first read. An effect that writes a plain Signal only reveals that edge with its first write:
+     * until then, a reader may share its level, run alongside it on the old value, and rerun on
+     * the next level. Derive values through ComputedSignal when that matters in parallel mode.
      * 
      * It is rare you will have to interact with this class yourself, as Observatory is the
      * recommended way of managing observers.
@@ -37,22 +73,85 @@ namespace cppreactive {
         template <typename R>
         friend class SignalBase;
 
-        std::mutex m_mutex;
-        std::vector<std::weak_ptr<Observer>> activeObs;
-        std::vector<std::weak_ptr<Observer>> scheduledObs;
+        struct ScheduledObserver {
+            uint32_t level;
+            uint64_t order;
+            std::weak_ptr<Observer> observer;
+
+            bool operator>(ScheduledObserver const& other) const {
+                return level != other.level ? level > other.level : order > other.order;
+            }
+        };
+
+        // Lock-free multi-producer single-consumer queue that `schedule()` pushes onto. Producers swap
+        // themselves in at the head, and `update()` takes them off the tail, so the two never share a line.
+        // Every producer bumps the pending count as well, so it shares the head's line rather than the tail's.
+        alignas(64) std::atomic<ScheduleNode*> m_incomingHead = &m_stub;
+        std::atomic<size_t> m_pending = 0;
+        alignas(64) ScheduleNode* m_incomingTail = &m_stub;
+        ScheduleNode m_stub;
+
+        /// Held throughout `update()`. Everything below is only touched by the thread holding it.
+        ObserverLock m_mutex;
+        std::priority_queue<ScheduledObserver, std::vector<ScheduledObserver>, std::greater<>> scheduledObs;
+        uint64_t m_scheduleCounter = 0;
+        std::unique_ptr<UpdatePool> m_pool;
+        std::function<void()> m_wakeup;
+        std::atomic<int> m_wakeupFd = -1;
 
         ObserverStack() = default;
+        ~ObserverStack();
+
+        using Deadline = std::chrono::steady_clock::time_point;
+
+        void pushIncoming(ScheduleNode* node);
+        ScheduleNode* popIncoming();
+        void collectScheduled();
+        std::shared_ptr<Observer> popScheduled(uint32_t maxLevel = UINT32_MAX);
+        void updateUntil(Deadline deadline);
+        void updateSerial(Deadline deadline);
+        void updateParallel(Deadline deadline);
+        void wakeUp();
 
         // Pointer-to-impl!!!
-        static bool observerSignalAdded(std::shared_ptr<Observer> ob, uint64_t id);
-        static void observerAddSignal(std::shared_ptr<Observer> ob, uint64_t id, std::function<void()> unreactFunc);
+        /// Marks the signal as read by the current run, returning false if the observer is not subscribed to it yet
+        static bool observerTrackSignal(std::shared_ptr<Observer> const& ob, uint64_t id);
+        static void observerAddSignal(std::shared_ptr<Observer> const& ob, uint64_t id, std::function<void()> unreactFunc);
+        /// Raises `ob` above `writer`, whose output it reads
+        static void observerDependOn(std::shared_ptr<Observer> const& ob, std::shared_ptr<Observer> const& writer);
      public:
         static ObserverStack* shared();
 
         // MUST BE CALLED BY USER
+        /// Runs every scheduled observer. Only one thread updates at a time: calling this while another thread
+        /// is updating, or from inside an effect, returns right away and leaves the queue to that update.
         void update();
+        /// Runs scheduled observers until `budget` is spent and leaves the rest queued, in order, for the next call.
+        /// At least one observer runs per call, so the queue always makes progress. With `setParallelism()`, the
+        /// budget is checked between levels.
+        void update(std::chrono::nanoseconds budget);
+        /// How many observers are waiting for `update()`. Observers destroyed while queued are counted until then.
+        size_t pending();
+
+        /// Sets a callback invoked whenever an observer is scheduled while none were pending, which is when
+        /// `update()` has work to do again. It runs on the scheduling thread and should only hand off to the
+        /// thread that calls `update()`. Producers read it without locking, so it must be set before anything
+        /// is scheduled and never changed while other threads may schedule observers.
+        void setWakeup(std::function<void()> wakeup);
+        /// Linux eventfd that becomes readable under the same condition as `setWakeup()`, for registering with
+        /// epoll or io_uring. `update()` resets it, and leaves it readable if the budget left work pending.
+        /// Created on first call, which is safe at any time and from any thread. Returns -1 on other platforms or if
+        /// it could not be created.
+        int wakeupFd();
+
+        /// Sets how many threads `update()` uses, the calling thread included. 0 or 1 runs every observer on the
+        /// calling thread, which is the default. Must not be called while an update is running. Values derived by
+        /// effects writing plain Signals are only ordered after their first write, see above.
+        void setParallelism(size_t threads);
 
         std::shared_ptr<Observer> create(std::function<void()> effect);
+        /// Creates a lazy observer. Instead of being queued for `update()`, scheduling it calls `invalidate` right away.
+        std::shared_ptr<Observer> create(std::function<void()> effect, std::function<void()> invalidate);
         std::shared_ptr<Observer> top();
         void run(std::shared_ptr<Observer> ob);
         void schedule(std::shared_ptr<Observer> ob);
@@ -63,19 +162,19 @@ namespace cppreactive {
      * Scoped manager for observers. Allows you to create and destroy Observer instances. That's it!
      */
     class CPP_REACTIVE_DLL Observatory {
-        std::mutex m_mutex;
+        ObserverLock m_mutex;
         std::vector<std::shared_ptr<Observer>> m_observers;
      public:
         Observatory() = default;
 
         Observatory(Observatory&& other) {
-            std::lock_guard<std::mutex> lock(other.m_mutex);
+            std::lock_guard<ObserverLock> lock(other.m_mutex);
             m_observers = std::move(other.m_observers);
         }
 
         template <typename F>
         std::shared_ptr<Observer> reactToChanges(F&& effect) {
-            std::lock_guard<std::mutex> lock(m_mutex);
+            std::lock_guard<ObserverLock> lock(m_mutex);
 
             auto ob = ObserverStack::shared()->create(std::forward<F>(effect));
             m_observers.push_back(ob);
@@ -94,8 +193,12 @@ namespace cppreactive {
     class SignalBase {
         template <typename T>
         auto intoOptional(T const& value) {
-            if constexpr (std::is_same_v<T, std::optional<typename T::value_type>>) {
-                return value;
+            if constexpr (requires { typename T::value_type; }) {
+                if constexpr (std::is_same_v<T, std::optional<typename T::value_type>>) {
+                    return value;
+                } else {
+                    return std::optional<T>(value);
+                }
             } else {
                 return std::optional<T>(value);
             }
@@ -105,6 +208,8 @@ namespace cppreactive {
      protected:
         R m_reactive;
         const uint64_t m_id = s_signalCounter++;
+        /// Observer computing this signal's value, if any. Never copied along with the signal.
+        std::weak_ptr<Observer> m_writer;
      public:
         SignalBase() : m_reactive() {}
         SignalBase(R&& initial) : m_reactive(std::move(initial)) {}
@@ -113,9 +218,15 @@ namespace cppreactive {
 
         R& operator*() {
             if (auto top = ObserverStack::shared()->top()) {
-                if (!ObserverStack::observerSignalAdded(top, m_id)) {
-                    auto ptr = intoOptional(m_reactive.react([top](auto) {
-                        ObserverStack::shared()->schedule(top);
+                // Readers of a computed value are ordered after whatever computes it from the first read on,
+                // rather than only once a write reveals the edge
+                if (auto writer = m_writer.lock(); writer && writer != top)
+                    ObserverStack::observerDependOn(top, writer);
+
+                if (!ObserverStack::observerTrackSignal(top, m_id)) {
+                    auto ptr = intoOptional(m_reactive.react([weak = std::weak_ptr<Observer>(top)](auto) {
+                        if (auto top = weak.lock())
+                            ObserverStack::shared()->schedule(top);
                     }));
 
 
@@ -137,31 +248,36 @@ namespace cppreactive {
         }
 
         uint64_t id() const { return m_id; }
+
+        /// Version of the underlying value, read without registering a dependency
+        auto version() requires requires(R& r) { r.version(); } {
+            return m_reactive.version();
+        }
     };
 
-    template <typename T>
-    class RefSignal : public SignalBase<ReactiveRef<T>> {
-        using SignalBase<ReactiveRef<T>>::SignalBase;
+    template <typename T, typename Compare = DefaultEqual<T>, typename Lock = std::mutex>
+    class RefSignal : public SignalBase<ReactiveRef<T, Compare, Lock>> {
+        using SignalBase<ReactiveRef<T, Compare, Lock>>::SignalBase;
      public:
-        RefSignal(ReactiveRef<T>&& value) : SignalBase<ReactiveRef<T>>(std::move(value)) {}
-        RefSignal(Reactive<T>& value) : SignalBase<ReactiveRef<T>>(value.ref()) {}
+        RefSignal(ReactiveRef<T, Compare, Lock>&& value) : SignalBase<ReactiveRef<T, Compare, Lock>>(std::move(value)) {}
+        RefSignal(Reactive<T, Compare, Lock>& value) : SignalBase<ReactiveRef<T, Compare, Lock>>(value.ref()) {}
     };
 
-    template <typename T>
-    class Signal : public SignalBase<Reactive<T>> {
-        using SignalBase<Reactive<T>>::SignalBase;
+    template <typename T, typename Compare = DefaultEqual<T>, typename Lock = std::mutex>
+    class Signal : public SignalBase<Reactive<T, Compare, Lock>> {
+        using SignalBase<Reactive<T, Compare, Lock>>::SignalBase;
      public:
 
         template <std::convertible_to<T> Q>
-        Signal(Q&& value) : SignalBase<Reactive<T>>(Reactive(value)) {}
+        Signal(Q&& value) : SignalBase<Reactive<T, Compare, Lock>>(Reactive<T, Compare, Lock>(std::forward<Q>(value))) {}
 
-        RefSignal<T> ref() {
-            return RefSignal<T>(this->m_reactive.ref());
+        RefSignal<T, Compare, Lock> ref() {
+            return RefSignal<T, Compare, Lock>(this->m_reactive.ref());
         }
     };
 
-    template <typename T>
-    class ComputedSignal : Signal<T> {
+    template <typename T, typename Compare = DefaultEqual<T>, typename Lock = std::mutex>
+    class ComputedSignal : Signal<T, Compare, Lock> {
         Observatory m_observatory;
         std::function<T()> m_compute;
      public:
@@ -169,14 +285,127 @@ namespace cppreactive {
 
         template <typename V> requires requires(V a) { {a()} -> std::same_as<T>; }
         ComputedSignal(V && compute) : m_compute(std::forward<V>(compute)) {
-            m_observatory.reactToChanges([this]() {
-                Signal<T>::operator*() = m_compute();
+            this->m_writer = m_observatory.reactToChanges([this]() {
+                Signal<T, Compare, Lock>::operator*() = m_compute();
             });
         }
 
-        Reactive<T> const& operator*() {
-            return Signal<T>::operator*();
+        Reactive<T, Compare, Lock> const& operator*() {
+            return Signal<T, Compare, Lock>::operator*();
         }
 
     };
+
+    /**
+     * Bookkeeping behind LazyComputedSignal that does not depend on the value type.
+     * 
+     * Dirty means a dependency changed. MaybeDirty means only a lazy dependency was invalidated,
+     * in which case the value is recomputed only if one of those ends up with a new version.
+     */
+    struct LazyNode {
+        enum State : uint8_t { Clean, MaybeDirty, Dirty };
+
+        std::mutex m_mutex;
+        std::atomic<uint8_t> m_state = Dirty;
+        std::atomic<uint64_t> m_version = 0;
+        std::vector<std::pair<std::weak_ptr<LazyNode>, uint64_t>> m_sources;
+        std::function<void()> m_recompute;
+
+        /// Raises the state, returning whether dependents still need to hear about it
+        bool invalidate(State state) {
+            auto current = m_state.load();
+            while (current < state) {
+                if (m_state.compare_exchange_weak(current, state))
+                    return current == Clean;
+            }
+            return false;
+        }
+
+        void refresh() {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            auto state = m_state.load();
+            if (state == Clean)
+                return;
+
+            bool changed = state == Dirty || sourcesChanged();
+            if (m_state.exchange(Clean) == Dirty || changed)
+                m_recompute();
+        }
+
+     private:
+        bool sourcesChanged() {
+            for (auto& [weak, version] : m_sources) {
+                auto source = weak.lock();
+                if (!source)
+                    return true;
+
+                source->refresh();
+                if (source->m_version != version)
+                    return true;
+            }
+            return false;
+        }
+    };
+
+    /// Lazy node currently computing on this thread, which records every lazy node it reads
+    inline thread_local LazyNode* s_lazyReader = nullptr;
+    /// Set while a lazy node tells its dependents that it might have changed
+    inline thread_local bool s_lazyPropagating = false;
+
+    /**
+     * Pull-based variant of ComputedSignal. A change in a dependency only marks the value dirty and
+     * tells dependents it may have changed; the computation itself runs on the next read.
+     * 
+     * Lazy dependents are only marked maybe-dirty, and when read they first bring their lazy dependencies
+     * up to date. If none of those actually changed, the memoized value is kept without recomputing.
+     */
+    template <typename T, typename Compare = DefaultEqual<T>, typename Lock = std::mutex>
+    class LazyComputedSignal : Signal<T, Compare, Lock> {
+        std::function<T()> m_compute;
+        std::shared_ptr<LazyNode> m_node = std::make_shared<LazyNode>();
+        bool m_computed = false;
+        std::shared_ptr<Observer> m_observer;
+
+        void recompute() {
+            m_node->m_sources.clear();
+
+            auto reader = std::exchange(s_lazyReader, m_node.get());
+            T value = m_compute();
+            s_lazyReader = reader;
+
+            if (m_computed && Compare()(this->m_reactive.get(), value))
+                return;
+
+            m_computed = true;
+            ++m_node->m_version;
+            this->m_reactive.set(std::move(value));
+        }
+
+        void invalidate() {
+            if (!m_node->invalidate(s_lazyPropagating ? LazyNode::MaybeDirty : LazyNode::Dirty))
+                return;
+
+            auto propagating = std::exchange(s_lazyPropagating, true);
+            this->m_reactive.notify();
+            s_lazyPropagating = propagating;
+        }
+     public:
+        LazyComputedSignal(LazyComputedSignal const& comp) : LazyComputedSignal(comp.m_compute) {}
+
+        template <typename V> requires requires(V a) { {a()} -> std::same_as<T>; }
+        LazyComputedSignal(V && compute) : m_compute(std::forward<V>(compute)) {
+            m_observer = ObserverStack::shared()->create([this]() { recompute(); }, [this]() { invalidate(); });
+            m_node->m_recompute = [this]() { ObserverStack::shared()->run(m_observer); };
+        }
+
+        Reactive<T, Compare, Lock> const& operator*() {
+            m_node->refresh();
+
+            if (s_lazyReader && s_lazyReader != m_node.get())
+                s_lazyReader->m_sources.emplace_back(m_node, m_node->m_version.load());
+
+            return Signal<T, Compare, Lock>::operator*();
+        }
+    };
 }
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+#include <Reactive.hpp>
+#include <Signal.hpp>
+
+namespace cppreactive {
+    /// Reactive for large values read from many threads, such as configuration blobs or big vectors.
+    ///
+    /// The value is an immutable snapshot behind an atomically swapped `std::shared_ptr<T const>`. `get()` pins
+    /// the current snapshot without taking the writer mutex or copying T, and the snapshot stays valid for as long
+    /// as the reader holds it, no matter how many writes happen meanwhile. `set()` builds the new value on the side
+    /// and publishes it in one store, so readers never observe a value being assigned.
+    ///
+    /// Reads are not lock-free: `std::atomic<std::shared_ptr>` isn't on common standard libraries. libstdc++
+    /// guards the pointer with a spin bit held for the length of a reference count update, so readers briefly
+    /// contend with each other and with the publishing store, but never wait on a writer's comparison or listeners.
+    ///
+    /// Unlike Reactive, the new value is published before listeners run, so `get()` from a listener returns it.
+    /// Writers and listener bookkeeping still share a mutex.
+    template <typename T, typename Compare = DefaultEqual<T>>
+    class SnapshotReactive {
+     public:
+        using Snapshot = std::shared_ptr<T const>;
+     private:
+        /// Owned by the SnapshotReactive alone, Refs only hold it weakly
+        struct Core : ListenerCore<Core, T, Snapshot> {
+            std::atomic<Snapshot> m_value;
+            std::atomic<uint64_t> m_version = 0;
+            [[no_unique_address]] Compare m_compare;
+
+            Core(Snapshot value, Compare compare) : m_value(std::move(value)), m_compare(std::move(compare)) {}
+
+            Snapshot current() const {
+                return m_value.load(std::memory_order_acquire);
+            }
+
+            uint64_t version() const {
+                return m_version.load(std::memory_order_acquire);
+            }
+
+            Snapshot load() const {
+                return current();
+            }
+
+            /// Called with the lock held
+            void store(Snapshot const& value) {
+                m_value.store(value, std::memory_order_release);
+                m_version.store(m_version.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+            }
+
+            template <typename Q>
+            bool set(std::shared_ptr<Core> const& self, Q&& val) {
+                this->publish(self, [next = makeSnapshot(std::forward<Q>(val))](Snapshot const&) { return next; });
+                return true;
+            }
+
+            template <typename F>
+            bool update(std::shared_ptr<Core> const& self, F& fn) {
+                this->publish(self, [&](Snapshot const& current) { return makeSnapshot(fn(*current)); });
+                return true;
+            }
+        };
+
+        std::shared_ptr<Core> m_core;
+
+        /// Throws `std::invalid_argument` when handed a null Snapshot, so the stored one can always be dereferenced
+        template <typename Q>
+        static Snapshot makeSnapshot(Q&& val) {
+            if constexpr (std::is_same_v<std::remove_cvref_t<Q>, Snapshot>) {
+                if (!val)
+                    throw std::invalid_argument("SnapshotReactive can't hold a null snapshot");
+                return std::forward<Q>(val);
+            } else {
+                return std::make_shared<T const>(std::forward<Q>(val));
+            }
+        }
+     public:
+        using ListenerIter = ListenerHandle;
+        /// `get()` pins the current snapshot, or returns null once the SnapshotReactive is gone
+        using Ref = CoreRef<Core, T>;
+
+        SnapshotReactive() requires std::is_default_constructible_v<T> : SnapshotReactive(T()) {}
+        SnapshotReactive(T const& initial) : m_core(std::make_shared<Core>(std::make_shared<T const>(initial), Compare())) {}
+        SnapshotReactive(T&& initial) : m_core(std::make_shared<Core>(std::make_shared<T const>(std::move(initial)), Compare())) {}
+        /// Throws `std::invalid_argument` if `initial` is null
+        SnapshotReactive(Snapshot initial) : m_core(std::make_shared<Core>(makeSnapshot(std::move(initial)), Compare())) {}
+
+        /// Copies share the current snapshot rather than the value itself
+        SnapshotReactive(SnapshotReactive const& other) : m_core(std::make_shared<Core>(other.get(), other.m_core->m_compare)) {}
+        SnapshotReactive(SnapshotReactive&& other) : m_core(std::exchange(other.m_core, nullptr)) {}
+
+        /// Publishes a new snapshot. Passing a Snapshot publishes it as is, without copying the value, and a null one
+        /// throws `std::invalid_argument`.
+        template <typename Q>
+        void set(Q&& val) {
+            m_core->set(m_core, std::forward<Q>(val));
+        }
+
+        /// Publishes `fn(value)` as the new snapshot with the writer lock held, so concurrent updates never lose
+        /// each other's writes. `fn` must not write to this SnapshotReactive itself.
+        template <typename F> requires std::convertible_to<std::invoke_result_t<F&, T const&>, T>
+        void update(F&& fn) {
+            m_core->update(m_core, fn);
+        }
+
+        /// Pins the current snapshot without copying the value. Never waits on the writer mutex, only on the atomic
+        /// pointer's own short internal lock.
+        Snapshot get() const {
+            return m_core->current();
+        }
+
+        template <typename Q>
+        SnapshotReactive& operator=(Q&& val) {
+            set(std::forward<Q>(val));
+            return *this;
+        }
+
+        SnapshotReactive& operator=(SnapshotReactive const& val) {
+            set(val.get());
+            return *this;
+        }
+        operator T() const {
+            return *get();
+        }
+
+        template <typename F> requires std::invocable<std::decay_t<F>&, T const&>
+        ListenerIter react(F&& fn) {
+            return m_core->react(std::forward<F>(fn));
+        }
+        void unreact(ListenerIter it) {
+            m_core->unreact(it);
+        }
+
+        /// Goes up by one every time a new snapshot is published
+        uint64_t version() const {
+            return m_core->version();
+        }
+
+        bool isInContext() const {
+            return m_core->notifying();
+        }
+
+        /// Like `Reactive::setDeferReentrant()`: a write made from within the value's own listener is dropped with a
+        /// warning by default, and applied once the current notification pass is over when deferred. Several such
+        /// writes coalesce into the last one.
+        void setDeferReentrant(bool defer) {
+            m_core->setDeferReentrant(defer);
+        }
+
+        Ref ref() {
+            return Ref(m_core);
+        }
+    };
+
+    template <typename T, typename Compare = DefaultEqual<T>>
+    class SnapshotSignal : public SignalBase<SnapshotReactive<T, Compare>> {
+        using SignalBase<SnapshotReactive<T, Compare>>::SignalBase;
+     public:
+
+        template <std::convertible_to<T> Q>
+        SnapshotSignal(Q&& value) : SignalBase<SnapshotReactive<T, Compare>>(SnapshotReactive<T, Compare>(T(std::forward<Q>(value)))) {}
+    };
+}
@@ -0,0 +1,421 @@
+#include <cpp-reactive.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <new>
+#include <string>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+    #include <sys/resource.h>
+#endif
+#ifdef _WIN32
+    #include <malloc.h>
+#endif
+
+using namespace cppreactive;
+
+/**
+ * Self-contained benchmark harness for the hot paths of cpp-reactive.
+ *
+ * Every benchmark prints one JSON object per line with ops/sec, ns/op, allocations/op
+ * and the peak RSS of the process so far, so results from two releases can be diffed.
+ *
+ * Usage: cpp-reactive-bench [--filter <substring>] [--min-time-ms <ms>]
+ */
+
+static std::atomic<uint64_t> s_allocations = 0;
+
+// MSVC has no std::aligned_alloc, and memory from its _aligned_malloc has to go back through _aligned_free
+static void* alignedAlloc(std::size_t alignment, std::size_t size) {
+#ifdef _WIN32
+    return _aligned_malloc(size, alignment);
+#else
+    return std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+#endif
+}
+static void alignedFree(void* ptr) {
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    std::free(ptr);
+#endif
+}
+
+void* operator new(std::size_t size) {
+    s_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (auto ptr = std::malloc(size ? size : 1))
+        return ptr;
+    throw std::bad_alloc();
+}
+void* operator new(std::size_t size, std::align_val_t align) {
+    s_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (auto ptr = alignedAlloc(static_cast<std::size_t>(align), size ? size : 1))
+        return ptr;
+    throw std::bad_alloc();
+}
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+void* operator new[](std::size_t size, std::align_val_t align) {
+    return operator new(size, align);
+}
+
+// Every form above allocates with malloc or its aligned form, but GCC assumes the replaced operator new does not
+// and flags each free
+#if defined(__GNUC__) && !defined(__clang__)
+    #pragma GCC diagnostic push
+    #pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept { alignedFree(ptr); }
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept { alignedFree(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept { alignedFree(ptr); }
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept { alignedFree(ptr); }
+#if defined(__GNUC__) && !defined(__clang__)
+    #pragma GCC diagnostic pop
+#endif
+
+static long peakRssKb() {
+#if defined(__unix__) || defined(__APPLE__)
+    rusage usage {};
+    getrusage(RUSAGE_SELF, &usage);
+    #ifdef __APPLE__
+        return usage.ru_maxrss / 1024;
+    #else
+        return usage.ru_maxrss;
+    #endif
+#else
+    return -1;
+#endif
+}
+
+static void update() {
+    ObserverStack::shared()->update();
+}
+
+struct Options {
+    std::string filter;
+    double minTimeMs = 200;
+};
+
+/// Runs `op` in growing rounds until a round takes at least the minimum time, then reports that round
+template <typename F>
+static void bench(Options const& opts, char const* name, F&& op) {
+    if (!opts.filter.empty() && std::string(name).find(opts.filter) == std::string::npos)
+        return;
+
+    using Clock = std::chrono::steady_clock;
+
+    op();
+
+    uint64_t iterations = 1;
+    while (true) {
+        auto allocations = s_allocations.load();
+        auto start = Clock::now();
+
+        for (uint64_t i = 0; i < iterations; ++i)
+            op();
+
+        auto elapsed = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+        allocations = s_allocations.load() - allocations;
+
+        if (elapsed >= opts.minTimeMs * 1e6 || iterations >= (uint64_t(1) << 40)) {
+            std::printf(
+                "{\"name\": \"%s\", \"iterations\": %llu, \"ns_per_op\": %.2f, \"ops_per_sec\": %.1f, \"allocs_per_op\": %.3f, \"peak_rss_kb\": %ld}\n",
+                name,
+                static_cast<unsigned long long>(iterations),
+                elapsed / iterations,
+                iterations / (elapsed / 1e9),
+                static_cast<double>(allocations) / iterations,
+                peakRssKb()
+            );
+            std::fflush(stdout);
+            return;
+        }
+
+        iterations *= elapsed < opts.minTimeMs * 1e5 ? 10 : 2;
+    }
+}
+
+static void benchReactive(Options const& opts) {
+    {
+        Reactive<int> value(0);
+        for (int i = 0; i < 40; ++i)
+            value.react([](int const&) {});
+
+        int next = 0;
+        bench(opts, "reactive_set_40_listeners", [&] { value = ++next; });
+    }
+    {
+        Reactive<int> value(0);
+        int next = 0;
+        bench(opts, "reactive_set_no_listeners", [&] { value = ++next; });
+    }
+    {
+        Reactive<int> value(0);
+        int sink = 0;
+        bench(opts, "reactive_get", [&] { sink += value.get(); });
+        if (sink == -1) std::puts("");
+    }
+    {
+        AtomicReactive<int> value(0);
+        int sink = 0;
+        bench(opts, "atomic_reactive_get", [&] { sink += value.get(); });
+        if (sink == -1) std::puts("");
+    }
+    {
+        SnapshotReactive<std::vector<int>> value(std::vector<int>(100000, 1));
+        size_t sink = 0;
+        bench(opts, "snapshot_reactive_get_100k", [&] { sink += value.get()->size(); });
+        if (sink == 1) std::puts("");
+    }
+    {
+        struct Pose { double values[8]; bool operator==(Pose const&) const = default; };
+        SeqlockReactive<Pose> value(Pose {});
+        double sink = 0;
+        bench(opts, "seqlock_reactive_get_64b", [&] { sink += value.get().values[0]; });
+        if (sink == 1) std::puts("");
+    }
+    {
+        Reactive<int> value(0);
+        bench(opts, "reactive_react_unreact", [&] { value.unreact(value.react([](int const&) {})); });
+    }
+}
+
+static void benchSession(Options const& opts) {
+    {
+        Reactive<std::vector<int>> value(std::vector<int>(100000, 1));
+        bench(opts, "reactive_session_vector_100k", [&] {
+            auto session = value.session();
+            ++(*session)[0];
+        });
+    }
+    {
+        Reactive<std::vector<int>> value(std::vector<int>(100000, 1));
+        bench(opts, "reactive_inplace_session_vector_100k", [&] {
+            auto session = value.inplaceSession();
+            ++(*session)[0];
+        });
+    }
+}
+
+static void benchSignal(Options const& opts) {
+    {
+        Signal<int> value = 0;
+        Observatory obs;
+        int sink = 0;
+        obs.reactToChanges([&] {
+            for (int i = 0; i < 100; ++i)
+                sink += value->get();
+        });
+
+        int next = 0;
+        bench(opts, "signal_tracked_read_x100", [&] {
+            *value = ++next;
+            update();
+        });
+    }
+    {
+        Signal<int> root = 0;
+        std::deque<ComputedSignal<int>> chain;
+        chain.emplace_back([&] { return (*root).get() + 1; });
+        for (int i = 1; i < 1000; ++i) {
+            auto& prev = chain.back();
+            chain.emplace_back([&prev] { return (*prev).get() + 1; });
+        }
+
+        int next = 0;
+        bench(opts, "deep_chain_1000", [&] {
+            *root = ++next;
+            update();
+        });
+    }
+    {
+        Signal<int> root = 0;
+        std::deque<ComputedSignal<int>> fan;
+        for (int i = 0; i < 1000; ++i)
+            fan.emplace_back([&root, i] { return (*root).get() + i; });
+
+        int next = 0;
+        bench(opts, "wide_fanout_1000", [&] {
+            *root = ++next;
+            update();
+        });
+    }
+    {
+        Signal<int> root = 0;
+        std::deque<ComputedSignal<int>> middle;
+        for (int i = 0; i < 100; ++i)
+            middle.emplace_back([&root, i] { return (*root).get() * i; });
+
+        int sink = 0;
+        Observatory obs;
+        obs.reactToChanges([&] {
+            sink = 0;
+            for (auto& node : middle)
+                sink += (*node).get();
+        });
+
+        int next = 0;
+        bench(opts, "diamond_100", [&] {
+            *root = ++next;
+            update();
+        });
+    }
+    {
+        // kairo-style triangle: a chain where a single sink reads every node
+        Signal<int> root = 0;
+        std::deque<ComputedSignal<int>> chain;
+        chain.emplace_back([&] { return (*root).get(); });
+        for (int i = 1; i < 10; ++i) {
+            auto& prev = chain.back();
+            chain.emplace_back([&prev] { return (*prev).get() + 1; });
+        }
+
+        int sink = 0;
+        Observatory obs;
+        obs.reactToChanges([&] {
+            sink = 0;
+            for (auto& node : chain)
+                sink += (*node).get();
+        });
+
+        int next = 0;
+        bench(opts, "triangle_10", [&] {
+            *root = ++next;
+            update();
+        });
+    }
+    {
+        // cellx: layers of four nodes, each layer reading the one before it
+        struct Layer {
+            ComputedSignal<int> a, b, c, d;
+        };
+
+        Signal<int> a0 = 1, b0 = 2, c0 = 3, d0 = 4;
+        std::deque<Layer> layers;
+        layers.push_back(Layer {
+            ComputedSignal<int>([&] { return (*b0).get(); }),
+            ComputedSignal<int>([&] { return (*a0).get() - (*c0).get(); }),
+            ComputedSignal<int>([&] { return (*b0).get() + (*d0).get(); }),
+            ComputedSignal<int>([&] { return (*c0).get(); }),
+        });
+        for (int i = 1; i < 1000; ++i) {
+            auto& prev = layers.back();
+            layers.push_back(Layer {
+                ComputedSignal<int>([&prev] { return (*prev.b).get(); }),
+                ComputedSignal<int>([&prev] { return (*prev.a).get() - (*prev.c).get(); }),
+                ComputedSignal<int>([&prev] { return (*prev.b).get() + (*prev.d).get(); }),
+                ComputedSignal<int>([&prev] { return (*prev.c).get(); }),
+            });
+        }
+
+        int next = 0;
+        bench(opts, "cellx_1000", [&] {
+            ++next;
+            batch([&] {
+                *a0 = next;
+                *b0 = next + 1;
+                *c0 = next + 2;
+                *d0 = next + 3;
+            });
+            update();
+        });
+    }
+    {
+        Signal<int> root = 0;
+        std::deque<LazyComputedSignal<int>> chain;
+        chain.emplace_back([&] { return (*root).get() + 1; });
+        for (int i = 1; i < 100; ++i) {
+            auto& prev = chain.back();
+            chain.emplace_back([&prev] { return (*prev).get() + 1; });
+        }
+
+        int next = 0;
+        bench(opts, "lazy_chain_100_10_writes_1_read", [&] {
+            for (int i = 0; i < 10; ++i)
+                *root = ++next;
+            (void)(*chain.back()).get();
+        });
+    }
+}
+
+static void benchParallel(Options const& opts) {
+    auto threads = std::max(2u, std::thread::hardware_concurrency());
+
+    for (bool parallel : { false, true }) {
+        ObserverStack::shared()->setParallelism(parallel ? threads : 0);
+
+        Signal<int> root = 0;
+        std::deque<ComputedSignal<int>> fan;
+        for (int i = 0; i < 64; ++i) {
+            fan.emplace_back([&root, i] {
+                // Stand-in for an expensive effect such as layout
+                uint32_t hash = (*root).get() + i;
+                for (int k = 0; k < 20000; ++k)
+                    hash = hash * 1664525 + 1013904223;
+                return static_cast<int>(hash);
+            });
+        }
+
+        int next = 0;
+        bench(opts, parallel ? "heavy_fanout_64_parallel" : "heavy_fanout_64_serial", [&] {
+            *root = ++next;
+            update();
+        });
+    }
+
+    ObserverStack::shared()->setParallelism(0);
+}
+
+static void benchVec(Options const& opts) {
+    {
+        ReactiveVec<int> vec;
+        vec.react([](std::vector<int> const&) {});
+
+        bench(opts, "reactive_vec_push_back", [&] {
+            vec.push_back(1);
+            if (vec.size() >= 100000)
+                vec.clear();
+        });
+    }
+    {
+        ReactiveVec<int> vec;
+        size_t patches = 0;
+        vec.reactPatch([&](VecPatch const&, std::vector<int> const&) { ++patches; });
+
+        bench(opts, "reactive_vec_push_back_patch_listener", [&] {
+            vec.push_back(1);
+            if (vec.size() >= 100000)
+                vec.clear();
+        });
+    }
+}
+
+int main(int argc, char** argv) {
+    Options opts;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            opts.filter = argv[++i];
+        } else if (std::strcmp(argv[i], "--min-time-ms") == 0 && i + 1 < argc) {
+            opts.minTimeMs = std::atof(argv[++i]);
+        } else {
+            std::fprintf(stderr, "usage: %s [--filter <substring>] [--min-time-ms <ms>]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    benchReactive(opts);
+    benchSession(opts);
+    benchSignal(opts);
+    benchParallel(opts);
+    benchVec(opts);
+}
@@ -2,4 +2,7 @@
 
 #include <Reactive.hpp>
 #include <Signal.hpp>
-#include <ReactiveVec.hpp>
\ No newline at end of file
+#include <ReactiveVec.hpp>
+#include <AtomicReactive.hpp>
+#include <SnapshotReactive.hpp>
+#include <SeqlockReactive.hpp>
\ No newline at end of file
@@ -1,4 +1,14 @@
 #include <Signal.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <thread>
+
+#ifdef __linux__
+    #include <sys/eventfd.h>
+    #include <unistd.h>
+#endif
 
 using namespace cppreactive;
 
@@ -8,30 +18,73 @@ using namespace cppreactive;
  * Signals are stored by their ID and a function that unreacts them. I store
  * a function for proper type erasure as Reactive is templated and this is not.
  * 
+ * Each signal also remembers the last run that read it. Subscriptions are kept
+ * between runs and only the ones a run did not read anymore are dropped after it,
+ * so an effect with stable dependencies does not resubscribe at all.
+ * 
  * Completely internally-used type. To the end user, this is completely opaque.
  * No instances of Observer are ever stored outside of heap-allocated space managed
  * by ObserverStack, meaning that changing the underlying structure does not break ABI.
  */
-struct cppreactive::Observer {
-    std::mutex m_mutex;
+struct cppreactive::Observer : ScheduleNode {
+    ObserverLock m_mutex;
     std::function<void()> const m_effect;
-    std::unordered_map<uint64_t, std::function<void()>> m_signals;
+    std::function<void()> const m_invalidate;
+    struct Dependency {
+        std::function<void()> unreact;
+        uint64_t run;
+    };
+
+    std::unordered_map<uint64_t, Dependency> m_signals;
+    uint64_t m_run = 0;
+    std::atomic<uint32_t> m_level = 0;
+    /// Whether the observer is waiting in the schedule queue, which keeps scheduling idempotent
+    std::atomic<bool> m_scheduled = false;
+    /// Keeps the observer alive while it is linked into the incoming queue. `update()` trades it for a weak reference.
+    std::shared_ptr<Observer> m_queuedSelf;
 
     Observer(std::function<void()> effect) : m_effect(effect) {}
+    Observer(std::function<void()> effect, std::function<void()> invalidate) : m_effect(effect), m_invalidate(invalidate) {}
     Observer(Observer const&) = delete;
 
-    bool signalAdded(uint64_t id) {
-        std::lock_guard<std::mutex> lock(m_mutex);
-        return m_signals.find(id) != m_signals.end();
+    bool trackSignal(uint64_t id) {
+        std::lock_guard<ObserverLock> lock(m_mutex);
+
+        auto it = m_signals.find(id);
+        if (it == m_signals.end())
+            return false;
+
+        it->second.run = m_run;
+        return true;
     }
     void addSignal(uint64_t id, std::function<void()> unreactFunc) {
-        std::lock_guard<std::mutex> lock(m_mutex);
-        m_signals[id] = unreactFunc;
+        std::lock_guard<ObserverLock> lock(m_mutex);
+        m_signals[id] = { std::move(unreactFunc), m_run };
+    }
+    void beginRun() {
+        std::lock_guard<ObserverLock> lock(m_mutex);
+        ++m_run;
+    }
+    /// Drops every signal the last run did not read
+    void endRun() {
+        std::lock_guard<ObserverLock> lock(m_mutex);
+        for (auto it = m_signals.begin(); it != m_signals.end();) {
+            if (it->second.run != m_run) {
+                it->second.unreact();
+                it = m_signals.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    void raiseLevel(uint32_t level) {
+        auto current = m_level.load();
+        while (current < level && !m_level.compare_exchange_weak(current, level));
     }
     void unreactAll() {
-        std::lock_guard<std::mutex> lock(m_mutex);
-        for (auto& [id, func] : m_signals) {
-            func();
+        std::lock_guard<ObserverLock> lock(m_mutex);
+        for (auto& [id, dep] : m_signals) {
+            dep.unreact();
         }
         m_signals.clear();
     }
@@ -41,32 +94,369 @@ struct cppreactive::Observer {
     }
 };
 
-bool ObserverStack::observerSignalAdded(std::shared_ptr<Observer> ob, uint64_t id) {
-    return ob->signalAdded(id);
+bool ObserverStack::observerTrackSignal(std::shared_ptr<Observer> const& ob, uint64_t id) {
+    return ob->trackSignal(id);
+}
+void ObserverStack::observerAddSignal(std::shared_ptr<Observer> const& ob, uint64_t id, std::function<void()> unreactFunc) {
+    return ob->addSignal(id, std::move(unreactFunc));
+}
+void ObserverStack::observerDependOn(std::shared_ptr<Observer> const& ob, std::shared_ptr<Observer> const& writer) {
+    ob->raiseLevel(writer->m_level + 1);
+}
+
+
+/**
+ * Worker threads for parallel updates. Each participant, the thread calling `update()` included,
+ * has its own deque of observers. A level is dealt out evenly across them, every participant works
+ * through its own deque from the back and steals from the front of the others once it runs dry,
+ * so a few expensive effects don't leave the rest of the threads idle.
+ */
+struct cppreactive::UpdatePool {
+    struct Queue {
+        std::mutex m_mutex;
+        std::deque<std::shared_ptr<Observer>> m_observers;
+    };
+
+    size_t const m_size;
+    std::unique_ptr<Queue[]> m_queues;
+    std::vector<std::thread> m_threads;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    uint64_t m_generation = 0;
+    bool m_stopping = false;
+    std::atomic<size_t> m_remaining = 0;
+    /// First exception thrown by an effect during `runAll()`, rethrown on the caller once the level is done
+    std::exception_ptr m_error;
+
+    UpdatePool(size_t size) : m_size(size), m_queues(new Queue[size]) {
+        for (size_t i = 1; i < size; ++i)
+            m_threads.emplace_back([this, i]() { work(i); });
+    }
+    UpdatePool(UpdatePool const&) = delete;
+
+    ~UpdatePool() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_wake.notify_all();
+
+        for (auto& thread : m_threads)
+            thread.join();
+    }
+
+    std::shared_ptr<Observer> take(size_t self) {
+        {
+            auto& own = m_queues[self];
+            std::lock_guard<std::mutex> lock(own.m_mutex);
+            if (!own.m_observers.empty()) {
+                auto ob = std::move(own.m_observers.back());
+                own.m_observers.pop_back();
+                return ob;
+            }
+        }
+
+        for (size_t i = 1; i < m_size; ++i) {
+            auto& other = m_queues[(self + i) % m_size];
+            std::lock_guard<std::mutex> lock(other.m_mutex);
+            if (!other.m_observers.empty()) {
+                auto ob = std::move(other.m_observers.front());
+                other.m_observers.pop_front();
+                return ob;
+            }
+        }
+
+        return nullptr;
+    }
+
+    void drain(size_t self) {
+        while (auto ob = take(self)) {
+            try {
+                ObserverStack::shared()->run(ob);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (!m_error)
+                    m_error = std::current_exception();
+            }
+            ob.reset();
+
+            if (m_remaining.fetch_sub(1) == 1) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_done.notify_all();
+            }
+        }
+    }
+
+    void work(size_t self) {
+        uint64_t seen = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_wake.wait(lock, [&]() { return m_stopping || m_generation != seen; });
+                if (m_stopping)
+                    return;
+                seen = m_generation;
+            }
+
+            drain(self);
+        }
+    }
+
+    /// Runs every observer across the pool, returning once all of them have finished. If effects threw, the rest of
+    /// the level still runs, and the first exception is rethrown afterwards.
+    void runAll(std::vector<std::shared_ptr<Observer>>& observers) {
+        m_remaining = observers.size();
+        for (size_t i = 0; i < observers.size(); ++i) {
+            auto& queue = m_queues[i % m_size];
+            std::lock_guard<std::mutex> lock(queue.m_mutex);
+            queue.m_observers.push_back(std::move(observers[i]));
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            ++m_generation;
+        }
+        m_wake.notify_all();
+
+        drain(0);
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done.wait(lock, [&]() { return m_remaining == 0; });
+
+        if (m_error)
+            std::rethrow_exception(std::exchange(m_error, nullptr));
+    }
+};
+
+ObserverStack::~ObserverStack() {
+    while (auto node = popIncoming())
+        static_cast<Observer*>(node)->m_queuedSelf.reset();
+
+#ifdef __linux__
+    if (auto fd = m_wakeupFd.load(); fd >= 0)
+        close(fd);
+#endif
+}
+
+void ObserverStack::setWakeup(std::function<void()> wakeup) {
+    m_wakeup = std::move(wakeup);
+}
+
+int ObserverStack::wakeupFd() {
+#ifdef __linux__
+    auto current = m_wakeupFd.load(std::memory_order_acquire);
+    if (current >= 0)
+        return current;
+
+    // Producers read the fd without locking, so it is published with a single compare-and-swap
+    auto fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    if (!m_wakeupFd.compare_exchange_strong(current, fd, std::memory_order_acq_rel)) {
+        close(fd);
+        return current;
+    }
+
+    // Nothing signalled it for what was already pending
+    if (pending() > 0) {
+        uint64_t one = 1;
+        (void)!write(fd, &one, sizeof(one));
+    }
+    return fd;
+#else
+    return -1;
+#endif
+}
+
+void ObserverStack::wakeUp() {
+    if (m_wakeup)
+        m_wakeup();
+#ifdef __linux__
+    if (auto fd = m_wakeupFd.load(std::memory_order_acquire); fd >= 0) {
+        uint64_t one = 1;
+        (void)!write(fd, &one, sizeof(one));
+    }
+#endif
+}
+
+void ObserverStack::setParallelism(size_t threads) {
+    std::lock_guard<ObserverLock> lock(m_mutex);
+    m_pool = threads > 1 ? std::make_unique<UpdatePool>(threads) : nullptr;
+}
+
+/// Whether the budget for this update ran out. `Deadline::max()` means no budget, which skips reading the clock.
+static bool pastDeadline(std::chrono::steady_clock::time_point deadline) {
+    return deadline != std::chrono::steady_clock::time_point::max() && std::chrono::steady_clock::now() >= deadline;
+}
+
+/**
+ * The incoming queue is Vyukov's intrusive MPSC queue. A push is one exchange on the head
+ * followed by linking the previous head to the new node, so producers never wait on anyone.
+ * Between those two steps the chain is briefly broken, and the consumer then sees the queue as
+ * empty; whatever it misses is picked up by the next collection, or announced by the wakeup
+ * at the end of `update()`.
+ */
+void ObserverStack::pushIncoming(ScheduleNode* node) {
+    node->m_next.store(nullptr, std::memory_order_relaxed);
+    auto prev = m_incomingHead.exchange(node, std::memory_order_acq_rel);
+    prev->m_next.store(node, std::memory_order_release);
+}
+
+ScheduleNode* ObserverStack::popIncoming() {
+    auto tail = m_incomingTail;
+    auto next = tail->m_next.load(std::memory_order_acquire);
+
+    if (tail == &m_stub) {
+        if (!next)
+            return nullptr;
+        m_incomingTail = tail = next;
+        next = next->m_next.load(std::memory_order_acquire);
+    }
+
+    if (next) {
+        m_incomingTail = next;
+        return tail;
+    }
+
+    // `tail` is the last node, or a producer is halfway through linking one after it
+    if (tail != m_incomingHead.load(std::memory_order_acquire))
+        return nullptr;
+
+    // The last node can only be taken once something follows it
+    pushIncoming(&m_stub);
+    if ((next = tail->m_next.load(std::memory_order_acquire))) {
+        m_incomingTail = next;
+        return tail;
+    }
+    return nullptr;
+}
+
+void ObserverStack::collectScheduled() {
+    while (auto node = popIncoming()) {
+        auto ob = std::move(static_cast<Observer*>(node)->m_queuedSelf);
+        scheduledObs.push({ ob->m_level, m_scheduleCounter++, ob });
+    }
 }
-void ObserverStack::observerAddSignal(std::shared_ptr<Observer> ob, uint64_t id, std::function<void()> unreactFunc) {
-    return ob->addSignal(id, unreactFunc);
+
+/// Takes the next observer to run, if there is one up to `maxLevel`
+std::shared_ptr<Observer> ObserverStack::popScheduled(uint32_t maxLevel) {
+    collectScheduled();
+
+    while (!scheduledObs.empty() && scheduledObs.top().level <= maxLevel) {
+        auto next = scheduledObs.top();
+        scheduledObs.pop();
+
+        auto lock = next.observer.lock();
+        if (!lock) {
+            m_pending.fetch_sub(1, std::memory_order_relaxed);
+            continue;
+        }
+
+        // The observer was found to depend on something deeper after being queued
+        if (auto level = lock->m_level.load(); level > next.level) {
+            scheduledObs.push({ level, next.order, std::move(next.observer) });
+            continue;
+        }
+
+        // Cleared before running so that anything changing during the run schedules it again
+        m_pending.fetch_sub(1, std::memory_order_relaxed);
+        lock->m_scheduled = false;
+        return lock;
+    }
+
+    return nullptr;
 }
 
+void ObserverStack::updateParallel(Deadline deadline) {
+    std::vector<std::shared_ptr<Observer>> level;
+
+    while (true) {
+        collectScheduled();
+        if (scheduledObs.empty())
+            return;
+
+        auto current = scheduledObs.top().level;
+        while (auto ob = popScheduled(current))
+            level.push_back(std::move(ob));
+
+        if (level.empty())
+            continue;
+
+        if (level.size() == 1)
+            run(level.front());
+        else
+            m_pool->runAll(level);
+        level.clear();
+
+        if (pastDeadline(deadline))
+            return;
+    }
+}
 
 // MUST BE CALLED BY USER
 void ObserverStack::update() {
-    m_mutex.lock();
+    updateUntil(Deadline::max());
+}
 
-    while (!scheduledObs.empty()) {
-        auto scheduled = scheduledObs;
-        scheduledObs.clear();
+void ObserverStack::update(std::chrono::nanoseconds budget) {
+    updateUntil(budget == std::chrono::nanoseconds::max() ? Deadline::max() : std::chrono::steady_clock::now() + budget);
+}
 
-        m_mutex.unlock();
-        for (auto& ptr : scheduled) {
-            if (auto lock = ptr.lock()) {
-                run(lock);
-            }
+/// Set while this thread is inside `update()`, so a nested call can return without touching the lock it already holds
+static thread_local bool s_updating = false;
+
+/// Marks this thread as updating for as long as it lives, so an effect throwing out of `update()` doesn't leave it set
+struct UpdatingScope {
+    UpdatingScope() { s_updating = true; }
+    UpdatingScope(UpdatingScope const&) = delete;
+    ~UpdatingScope() { s_updating = false; }
+};
+
+void ObserverStack::updateUntil(Deadline deadline) {
+    if (s_updating)
+        return;
+
+    {
+        std::unique_lock<ObserverLock> lock(m_mutex, std::try_to_lock);
+        if (!lock)
+            return;
+        UpdatingScope updating;
+
+#ifdef __linux__
+        // Reset before draining, so anything scheduled from here on signals it again
+        if (auto fd = m_wakeupFd.load(std::memory_order_acquire); fd >= 0) {
+            uint64_t count;
+            (void)!read(fd, &count, sizeof(count));
         }
-        m_mutex.lock();
+#endif
+
+        if (m_pool)
+            updateParallel(deadline);
+        else
+            updateSerial(deadline);
     }
 
-    m_mutex.unlock();
+    // Checked only once unlocked: an observer scheduled while the lock was held may have had its wakeup call
+    // `update()` and find it busy. Out of budget, or a push still being linked when the queue looked empty, are
+    // left pending as well. Nothing would signal any of those otherwise.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (pending() > 0)
+        wakeUp();
+}
+
+size_t ObserverStack::pending() {
+    return m_pending.load(std::memory_order_relaxed);
+}
+
+void ObserverStack::updateSerial(Deadline deadline) {
+    while (auto ob = popScheduled()) {
+        run(ob);
+
+        if (pastDeadline(deadline))
+            return;
+    }
 }
 
 
@@ -82,54 +472,75 @@ std::shared_ptr<Observer> ObserverStack::create(std::function<void()> effect) {
     return ptr;
 }
 
-std::shared_ptr<Observer> ObserverStack::top() {
-    std::lock_guard<std::mutex> lock(m_mutex);
+std::shared_ptr<Observer> ObserverStack::create(std::function<void()> effect, std::function<void()> invalidate) {
+    return std::make_shared<Observer>(std::move(effect), std::move(invalidate));
+}
+
+/**
+ * Observers running on this thread, innermost last. An observer only ever runs on a single
+ * thread at a time, so tracked reads never have to synchronize with other threads. Entries
+ * are strong references, but only for as long as `run()` holds one anyway.
+ */
+static thread_local std::vector<std::shared_ptr<Observer>> s_activeObs;
 
-    if (activeObs.empty())
+std::shared_ptr<Observer> ObserverStack::top() {
+    if (s_activeObs.empty())
         return nullptr;
 
-    if (auto lock = activeObs.back().lock()) {
-        return lock;
-    } else {
-        activeObs.pop_back();
-        return top();
-    }
+    return s_activeObs.back();
 }
 
-void ObserverStack::run(std::shared_ptr<Observer> ob) {
-    m_mutex.lock();
+/// Keeps an observer on this thread's active stack for as long as it lives, even if its effect throws. A run cut
+/// short keeps the signals it read up to that point.
+struct RunScope {
+    std::shared_ptr<Observer> const& ob;
 
-    activeObs.push_back(ob);
-    ob->unreactAll();
-
-    m_mutex.unlock();
-    ob->m_effect();
-    m_mutex.lock();
+    RunScope(std::shared_ptr<Observer> const& ob) : ob(ob) {
+        s_activeObs.push_back(ob);
+        ob->beginRun();
+    }
+    RunScope(RunScope const&) = delete;
 
-    activeObs.pop_back();
+    ~RunScope() {
+        ob->endRun();
+        s_activeObs.pop_back();
+    }
+};
 
-    m_mutex.unlock();
+void ObserverStack::run(std::shared_ptr<Observer> ob) {
+    RunScope scope(ob);
+    ob->m_effect();
 }
 
 void ObserverStack::schedule(std::shared_ptr<Observer> ob) {
-    std::lock_guard<std::mutex> lock(m_mutex);
+    // Avoid circular effects
+    if (std::find(s_activeObs.begin(), s_activeObs.end(), ob) != s_activeObs.end())
+        return;
 
-    // Avoid circular effects while also pruning
-    for (size_t i = 0; i < activeObs.size(); ++i) {
-        if (auto lock = activeObs[i].lock()) {
-            if (lock == ob) {
-                return;
-            }
-        } else {
-            activeObs.erase(activeObs.begin() + i);
-            --i;
-        }
+    // Lazy observers are never queued, they only get told their inputs changed
+    if (ob->m_invalidate) {
+        ob->m_invalidate();
+        return;
     }
 
-    scheduledObs.push_back(ob);
+    // Whoever is running wrote a signal that `ob` depends on, so `ob` has to come after it
+    if (!s_activeObs.empty()) {
+        ob->raiseLevel(s_activeObs.back()->m_level + 1);
+    }
+
+    if (ob->m_scheduled.exchange(true))
+        return;
+
+    bool wasEmpty = m_pending.fetch_add(1) == 0;
+    auto node = ob.get();
+    node->m_queuedSelf = std::move(ob);
+    pushIncoming(node);
+
+    if (wasEmpty)
+        wakeUp();
 }
 
 void Observatory::unreact(std::shared_ptr<Observer> ob) {
-    std::lock_guard<std::mutex> lock(m_mutex);
+    std::lock_guard<ObserverLock> lock(m_mutex);
     m_observers.erase(std::remove(m_observers.begin(), m_observers.end(), ob), m_observers.end());
 }
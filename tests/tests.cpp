@@ -0,0 +1,359 @@
+#include <cpp-reactive.hpp>
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace cppreactive;
+
+/**
+ * Stress and behaviour checks for the concurrency guarantees of cpp-reactive.
+ *
+ * Each check is a function registered under a name, and CTest runs every one of them as its own test.
+ * They are most useful built with `-fsanitize=thread`, which turns a race that happens to give the right
+ * answer into a failure.
+ *
+ * Usage: cpp-reactive-tests [<name>...]
+ */
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            std::abort(); \
+        } \
+    } while (false)
+
+static ObserverStack* stack() {
+    return ObserverStack::shared();
+}
+
+/// Several threads schedule observers at once, some of which die while queued, while another thread keeps
+/// updating. Every observer has to see the last value its producer wrote, and nothing may stay pending.
+static void checkMpsc() {
+    constexpr int producers = 4;
+    constexpr int writes = 20000;
+
+    std::deque<Signal<int>> signals(producers);
+    std::deque<Observatory> observatories(producers);
+    std::atomic<int> seen[producers];
+    for (int i = 0; i < producers; ++i) {
+        seen[i] = -1;
+        observatories[i].reactToChanges([&, i] { seen[i] = int(*signals[i]); });
+    }
+    stack()->update();
+
+    std::atomic<bool> done = false;
+    std::thread consumer([&] {
+        while (!done)
+            stack()->update();
+    });
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < producers; ++i) {
+        threads.emplace_back([&, i] {
+            for (int k = 1; k <= writes; ++k)
+                *signals[i] = k;
+        });
+    }
+    threads.emplace_back([&] {
+        for (int k = 0; k < 2000; ++k) {
+            Observatory doomed;
+            doomed.reactToChanges([&] { (void)int(*signals[0]); });
+        }
+    });
+
+    for (auto& thread : threads)
+        thread.join();
+    done = true;
+    consumer.join();
+
+    while (stack()->pending())
+        stack()->update();
+    for (int i = 0; i < producers; ++i)
+        CHECK(seen[i] == writes);
+}
+
+/// A value scheduled while `update()` is finishing must not be left without a wakeup
+static void checkWakeup() {
+    std::atomic<int> wakes = 0;
+    stack()->setWakeup([&] { ++wakes; });
+
+    Signal<int> value = 0;
+    Observatory observatory;
+    std::atomic<int> seen = 0;
+    observatory.reactToChanges([&] { seen = int(*value); });
+    stack()->update();
+
+    constexpr int writes = 20000;
+    std::thread producer([&] {
+        for (int k = 1; k <= writes; ++k)
+            *value = k;
+    });
+
+    // Only update when woken, like an event loop would
+    int handled = 0;
+    while (seen != writes) {
+        if (wakes.load() != handled) {
+            handled = wakes.load();
+            stack()->update();
+        } else {
+            std::this_thread::yield();
+        }
+    }
+    producer.join();
+
+    stack()->update();
+    stack()->setWakeup(nullptr);
+    CHECK(stack()->pending() == 0);
+}
+
+/// Readers must never see a value that is half written
+static void checkSeqlock() {
+    struct Pose {
+        uint64_t fields[8];
+        bool operator==(Pose const&) const = default;
+    };
+
+    SeqlockReactive<Pose> pose(Pose {});
+    std::atomic<bool> done = false;
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 3; ++i) {
+        readers.emplace_back([&] {
+            while (!done) {
+                auto read = pose.get();
+                for (auto field : read.fields)
+                    CHECK(field == read.fields[0]);
+            }
+        });
+    }
+
+    std::atomic<uint64_t> last = 0;
+    pose.react([&](Pose const& value) { last = value.fields[0]; });
+    for (uint64_t i = 1; i <= 100000; ++i) {
+        Pose next;
+        for (auto& field : next.fields)
+            field = i;
+        pose = next;
+    }
+    done = true;
+    for (auto& reader : readers)
+        reader.join();
+
+    CHECK(last == 100000);
+    CHECK(pose.version() == 100000);
+}
+
+/// Spreads levels across the pool. Every level has to settle before the next one reads it, and wide levels have
+/// to get done no matter how the work ends up stolen.
+static void checkPool() {
+    stack()->setParallelism(4);
+
+    Signal<int> root = 0;
+    std::deque<ComputedSignal<int>> wide;
+    for (int i = 0; i < 64; ++i) {
+        wide.emplace_back([&root, i] {
+            volatile long spin = 0;
+            for (int k = 0; k < (i % 8) * 1000; ++k)
+                spin = spin + k;
+            return int(*root) * i;
+        });
+    }
+    std::deque<ComputedSignal<int>> chain;
+    chain.emplace_back([&root] { return int(*root); });
+    for (int i = 1; i < 50; ++i) {
+        auto& previous = chain.back();
+        chain.emplace_back([&previous] { return int(*previous) + 1; });
+    }
+
+    std::atomic<int> runs = 0;
+    long sum = 0;
+    Observatory observatory;
+    observatory.reactToChanges([&] {
+        ++runs;
+        sum = 0;
+        for (auto& signal : wide)
+            sum += int(*signal);
+    });
+    stack()->update();
+
+    for (int value = 1; value <= 20; ++value) {
+        *root = value;
+        stack()->update();
+
+        CHECK(sum == value * (63 * 64 / 2));
+        CHECK(int(*chain.back()) == value + 49);
+    }
+    CHECK(runs == 21);
+    CHECK(stack()->pending() == 0);
+
+    stack()->setParallelism(0);
+}
+
+/// An effect throwing on any thread finishes its level and rethrows on the caller. Later levels run next update.
+static void checkPoolThrow() {
+    stack()->setParallelism(3);
+
+    Signal<int> root = 0;
+    std::atomic<bool> armed = false;
+    std::atomic<int> runs = 0;
+    std::deque<Observatory> observatories(16);
+    for (int i = 0; i < 16; ++i) {
+        observatories[i].reactToChanges([&, i] {
+            (void)int(*root);
+            if (armed && i % 2)
+                throw std::runtime_error("effect failed");
+            ++runs;
+        });
+    }
+    ComputedSignal<int> next([&root] { return int(*root) + 1; });
+    std::atomic<int> after = 0;
+    Observatory tail;
+    tail.reactToChanges([&] {
+        (void)int(*next);
+        ++after;
+    });
+    stack()->update();
+
+    runs = 0;
+    after = 0;
+    armed = true;
+    *root = 1;
+    bool caught = false;
+    try {
+        stack()->update();
+    } catch (std::runtime_error const&) {
+        caught = true;
+    }
+    CHECK(caught && runs == 8);
+
+    stack()->update();
+    CHECK(after == 1 && stack()->pending() == 0);
+
+    stack()->setParallelism(0);
+}
+
+/// Writes made from within a value's own listener converge one pass at a time when deferred
+template <typename R>
+static void checkDeferred(R& value) {
+    value.setDeferReentrant(true);
+
+    std::vector<int> seen;
+    value.react([&](int const& current) {
+        seen.push_back(current);
+        if (current < 5) {
+            // Coalesces into the update, which builds on the pending write
+            value.set(current + 10);
+            value.update([](int pending) { return pending - 9; });
+        }
+    });
+
+    value.set(1);
+    CHECK((seen == std::vector<int> { 1, 2, 3, 4, 5 }));
+    CHECK(int(value) == 5);
+
+    seen.clear();
+    batch([&] {
+        value.set(0);
+        value.set(3);
+    });
+    CHECK((seen == std::vector<int> { 3, 4, 5 }));
+}
+
+static void checkReentrancy() {
+    Reactive<int> reactive(0);
+    checkDeferred(reactive);
+    SnapshotReactive<int> snapshot(0);
+    checkDeferred(snapshot);
+    SeqlockReactive<int> seqlock(0);
+    checkDeferred(seqlock);
+
+    ReactiveVec<int> vec;
+    vec.setDeferReentrant(true);
+    std::vector<size_t> sizes;
+    vec.reactPatch([&](VecPatch const&, std::vector<int> const& current) {
+        sizes.push_back(current.size());
+        if (current.size() < 3)
+            vec.push_back(0);
+    });
+    vec.push_back(1);
+    CHECK((sizes == std::vector<size_t> { 1, 2, 3 }));
+
+    // There is no copy to hand out for a value that can't be copied
+    Reactive<std::unique_ptr<int>> moveOnly(std::make_unique<int>(0));
+    moveOnly.setDeferReentrant(true);
+    int threw = 0;
+    moveOnly.react([&](std::unique_ptr<int> const&) {
+        try {
+            auto session = moveOnly.inplaceSession();
+        } catch (std::logic_error const&) {
+            ++threw;
+        }
+    });
+    {
+        auto session = moveOnly.inplaceSession();
+        *session = std::make_unique<int>(1);
+    }
+    CHECK(threw == 1 && *moveOnly.get() == 1);
+}
+
+/// Concurrent `update()` calls on one Reactive must never lose each other's increments
+static void checkUpdate() {
+    Reactive<int> counter(0);
+    std::atomic<int> notified = 0;
+    counter.react([&](int) { ++notified; });
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.emplace_back([&] {
+            for (int k = 0; k < 10000; ++k)
+                ++counter;
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+
+    CHECK(int(counter) == 40000);
+    CHECK(notified == 40000);
+}
+
+struct Check {
+    char const* name;
+    void (*run)();
+};
+
+static Check const s_checks[] = {
+    { "mpsc", checkMpsc },
+    { "wakeup", checkWakeup },
+    { "seqlock", checkSeqlock },
+    { "pool", checkPool },
+    { "pool_throw", checkPoolThrow },
+    { "reentrancy", checkReentrancy },
+    { "update", checkUpdate },
+};
+
+int main(int argc, char** argv) {
+    int ran = 0;
+    for (auto const& check : s_checks) {
+        bool selected = argc == 1;
+        for (int i = 1; i < argc; ++i)
+            selected = selected || std::strcmp(argv[i], check.name) == 0;
+        if (!selected)
+            continue;
+
+        check.run();
+        std::printf("%s ok\n", check.name);
+        ++ran;
+    }
+
+    if (ran == 0) {
+        std::fprintf(stderr, "usage: %s [<name>...]\n", argv[0]);
+        return 1;
+    }
+}